@@ -1,7 +1,21 @@
 #pragma once
 #include <string>
-#include <map>
+#include <unordered_map>
+#include <vector>
 #include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+// 会话统计
+struct SessionStats {
+    size_t active;
+    uint64_t created;
+    uint64_t expired;
+    uint64_t removed;
+};
 
 class Auth {
 public:
@@ -11,8 +25,54 @@ public:
     bool loginUser(const std::string& username, const std::string& password, std::string& token, std::string& role);
     void removeToken(const std::string& token);
 
+    // 令牌空闲超过 ttl 秒后失效, 每次验证成功都会顺延
+    void setSessionTtl(int64_t seconds);
+    // 启动后台线程按时间轮回收过期令牌
+    void startReaper();
+    SessionStats getSessionStats() const;
+
 private:
     Auth() = default;
-    std::mutex tokensMutex;
-    std::map<std::string, std::pair<std::string, std::string>> tokens;
-};
\ No newline at end of file
+    ~Auth();
+    static const size_t SHARD_COUNT = 16;
+    // 时间轮: 每格 WHEEL_TICK 秒, 共 WHEEL_SLOTS 格; 超出一圈的令牌到期前会被重新挂到对应格子
+    static const int64_t WHEEL_TICK = 10;
+    static const size_t WHEEL_SLOTS = 64;
+
+    struct Session {
+        std::string role;
+        std::string username;
+        // 到期时间 (单调时钟秒), 验证时在读锁下更新
+        std::atomic<int64_t> expiresAt;
+
+        Session(const std::string& r, const std::string& u, int64_t e) : role(r), username(u), expiresAt(e) {}
+    };
+
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, Session> sessions;
+    };
+
+    Shard shards[SHARD_COUNT];
+    std::atomic<int64_t> ttl{8 * 3600};
+
+    std::mutex wheelMutex;
+    std::vector<std::string> wheel[WHEEL_SLOTS];
+    int64_t wheelTick = 0;
+
+    std::atomic<size_t> activeSessions{0};
+    std::atomic<uint64_t> createdSessions{0};
+    std::atomic<uint64_t> expiredSessions{0};
+    std::atomic<uint64_t> removedSessions{0};
+
+    std::mutex reaperMutex;
+    std::condition_variable reaperCv;
+    bool reaperStop = false;
+    std::thread reaperThread;
+
+    Shard& shardFor(const std::string& token);
+    void addSession(const std::string& token, const std::string& role, const std::string& username);
+    void schedule(const std::string& token, int64_t expiresAt);
+    void reapTick(int64_t tick);
+    void reaperLoop();
+};
@@ -0,0 +1,236 @@
+#pragma once
+#include "spsc_queue.hpp"
+#include "bot_sender.hpp"
+#include "plate_recognizer.hpp"
+#include "cascade_pool.hpp"
+#include "motion_gate.hpp"
+#include "plate_tracker.hpp"
+#include "plate_vote.hpp"
+#include "frame_source.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <regex>
+#include <unordered_map>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+// 各路摄像头共用的设置; 画面尺寸和像素格式由各路的 FrameSource 决定
+struct PipelineConfig {
+    // 检测和跟踪在缩小到这个宽度的画面上进行, 车牌区域映射回原分辨率再识别; 0 表示不缩小
+    int detectWidth = 640;
+    // 预分配的帧缓冲数, 也是读帧线程和检测线程之间的队列长度
+    size_t frameSlots = 4;
+    // OCR 线程数, 0 表示按 CPU 核数减去各路的检测线程
+    size_t ocrWorkers = 0;
+    // 各路共用的级联分类器数, 0 表示摄像头数的一半 (至少 1)
+    size_t cascades = 0;
+    // 每个 OCR 线程为每路摄像头保留的待识别队列长度
+    size_t ocrQueue = 16;
+    // OCR 引擎设置和车牌格式, 格式不符的识别结果不参加表决
+    OcrOptions ocr;
+    // 检测跟不上时 true 丢弃新读到的帧, false 暂停读取; 文件来源总是暂停读取
+    bool dropFrames = true;
+    // false 时为无界面模式, 不调用任何 OpenCV 窗口函数
+    bool display = true;
+    // 运动检测: 缩小后变化像素比例低于 motionThreshold 时跳过车牌检测, 0 表示不跳过
+    double motionThreshold = 0.005;
+    int motionPixelThreshold = 25;
+    // 连续跳过这么多帧后强制检测一次
+    int motionMaxSkip = 30;
+    // 检测到车牌后在之后的帧里跟踪车牌区域, 每隔 redetectInterval 帧或跟丢时重新整帧检测, 0 表示不跟踪
+    int redetectInterval = 10;
+    // 模板匹配分数 (归一化相关系数) 低于该值视为跟丢
+    double trackMinScore = 0.6;
+    // 连续这么多次检测不到车牌才算车辆离开, 避免检测闪烁把一次通行拆成多次
+    int passEndFrames = 5;
+    // 同一次通行攒够这么多个识别结果就表决上报, 不足时在车辆离开后用已有结果表决
+    size_t voteFrames = 5;
+    // 表决置信度低于该值时不上报
+    double voteMinConfidence = 0.5;
+    // 同一车牌在这么多秒内只上报一次
+    int plateCooldownSeconds = 60;
+};
+
+struct PipelineStats {
+    uint64_t framesRead = 0;
+    uint64_t framesDropped = 0;
+    uint64_t framesDetected = 0;
+    // 画面没有变化、沿用上次检测结果的帧
+    uint64_t framesStatic = 0;
+    // 通过跟踪得到车牌位置、没有整帧检测的帧, 以及跟丢的次数
+    uint64_t framesTracked = 0;
+    uint64_t trackLost = 0;
+    uint64_t candidates = 0;
+    // 所属车辆已上报、不再识别的车牌区域
+    uint64_t skipped = 0;
+    uint64_t recognized = 0;
+    // 识别结果不符合车牌格式、不参加表决的车牌区域
+    uint64_t invalid = 0;
+    uint64_t events = 0;
+    // 置信度过低未上报的通行, 以及冷却时间内重复、未上报的车牌
+    uint64_t rejected = 0;
+    uint64_t suppressed = 0;
+    // 所有 OCR 队列都满、检测线程等待的次数
+    uint64_t stalls = 0;
+};
+
+// 帧处理流水线, 一个进程可以处理多路摄像头:
+// 每路摄像头有自己的读帧线程 (从 FrameSource 读入预分配的帧缓冲) 和检测线程, 级联分类器和 OCR 线程池由各路共用,
+// 主线程负责表决、上报和显示
+// 相邻两级之间都是有界单生产者单消费者队列; OCR 跟不上时检测线程等待,
+// 帧缓冲随之用尽, 读帧线程丢弃新帧而不是积压, 已检测出的车牌区域都会被识别
+// OCR 线程轮流从各路摄像头的队列取车牌区域, 一路车流大时不会饿死其他路
+// 车牌从出现到连续几帧检测不到算作一次通行, 每次通行的多个识别结果表决后只上报一次
+class PlatePipeline {
+public:
+    explicit PlatePipeline(const PipelineConfig& config);
+    ~PlatePipeline();
+
+    // 添加一路摄像头, 需在 start 之前调用; action 为该路的角色, 识别结果通过 sender 上报
+    void addCamera(const std::string& name, FrameSource& source, EventSender& sender, const std::string& action);
+    // 加载模型、初始化 OCR 引擎并启动各线程
+    bool start();
+    // 在主线程运行, 直到全部输入结束或按 q 退出
+    void run();
+    // 可以在信号处理函数中调用
+    void requestStop() { stopping.store(true); }
+    // 各路摄像头的合计
+    PipelineStats stats() const;
+
+private:
+    static const int STATS_INTERVAL_SECONDS = 10;
+    static const size_t PASS_END_QUEUE = 64;
+
+    struct Candidate {
+        size_t camera = 0;
+        uint64_t seq = 0;
+        uint64_t pass = 0;
+        cv::Mat roi;
+    };
+
+    // 每个车牌区域都产生一个结果, 包括跳过和识别不出的, 主线程据此判断一次通行的结果是否到齐
+    struct Result {
+        size_t camera = 0;
+        uint64_t seq = 0;
+        uint64_t pass = 0;
+        std::string plate;
+        int confidence = 0;
+    };
+
+    // 检测线程通知主线程一次通行结束, 以及这次通行一共交给 OCR 的车牌区域数
+    struct PassEnd {
+        uint64_t pass = 0;
+        uint64_t candidates = 0;
+    };
+
+    struct PassState {
+        PlateVote vote;
+        uint64_t received = 0;
+        uint64_t expected = 0;
+        bool ended = false;
+        bool decided = false;
+    };
+
+    struct Counters {
+        std::atomic<uint64_t> framesRead{0};
+        std::atomic<uint64_t> framesDropped{0};
+        std::atomic<uint64_t> framesDetected{0};
+        std::atomic<uint64_t> framesStatic{0};
+        std::atomic<uint64_t> framesTracked{0};
+        std::atomic<uint64_t> trackLost{0};
+        std::atomic<uint64_t> candidates{0};
+        std::atomic<uint64_t> skipped{0};
+        std::atomic<uint64_t> recognized{0};
+        std::atomic<uint64_t> invalid{0};
+        std::atomic<uint64_t> events{0};
+        std::atomic<uint64_t> rejected{0};
+        std::atomic<uint64_t> suppressed{0};
+        std::atomic<uint64_t> stalls{0};
+    };
+
+    struct Camera {
+        size_t index = 0;
+        std::string name;
+        // 多路时输出信息前加上 [名称]
+        std::string prefix;
+        FrameSource& source;
+        EventSender& sender;
+        std::string action;
+        bool dropFrames = true;
+        // 检测用画面的尺寸, 以及检测坐标到原图坐标的比例
+        cv::Size detectSize;
+        double scaleX = 1.0;
+        double scaleY = 1.0;
+
+        MotionGate motionGate;
+        PlateTracker tracker;
+        std::vector<FrameBuffer> frames;
+        // 读帧线程 -> 检测线程, 以及检测线程归还的空闲帧
+        SpscQueue<FrameBuffer*> ready;
+        SpscQueue<FrameBuffer*> freeFrames;
+        // 检测线程 -> 主线程, 只保留最近的画面
+        SpscQueue<cv::Mat> display;
+        SpscQueue<PassEnd> passEnds;
+        std::thread readThread;
+        std::thread detectThread;
+        std::atomic<bool> readDone{false};
+        std::atomic<bool> detectDone{false};
+        // 最近一次已表决的通行编号, 检测线程和 OCR 线程据此跳过该车辆
+        std::atomic<uint64_t> postedPass{0};
+        // 检测线程下一次先尝试的 OCR 线程
+        size_t nextWorker = 0;
+        // 以下只由主线程访问
+        std::map<uint64_t, PassState> passes;
+        std::unordered_map<std::string, std::chrono::steady_clock::time_point> lastPosted;
+        Counters counters;
+
+        Camera(const PipelineConfig& config, const std::string& name, FrameSource& source,
+               EventSender& sender, const std::string& action);
+        // 把检测画面上的车牌区域映射回原图, 并裁剪到画面之内
+        cv::Rect toFrameRect(const cv::Rect& rect) const;
+    };
+
+    struct Worker {
+        tesseract::TessBaseAPI ocr;
+        // 每路摄像头一个待识别队列
+        std::vector<std::unique_ptr<SpscQueue<Candidate>>> candidates;
+        SpscQueue<Result> results;
+        // 下一次先看的摄像头, 各路轮流
+        size_t nextCamera = 0;
+        std::thread thread;
+        std::atomic<bool> done{false};
+
+        explicit Worker(size_t capacity) : results(capacity) {}
+    };
+
+    PipelineConfig config;
+    CascadePool cascades;
+    // 车牌格式, 各 OCR 线程共用 (只读)
+    std::regex platePattern;
+    std::vector<std::unique_ptr<Camera>> cameras;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> stopping{false};
+
+    void readLoop(Camera& camera);
+    void detectLoop(Camera& camera);
+    void ocrLoop(Worker& worker);
+    // 按轮转把车牌区域交给 OCR 线程, 全部队列已满时等待; 退出时返回 false
+    bool dispatch(Camera& camera, Candidate& candidate);
+    // 检测线程通知通行结束, 退出时返回 false
+    bool endPass(Camera& camera, uint64_t pass, uint64_t count);
+    void handleResult(const Result& result);
+    void handlePassEnd(Camera& camera, const PassEnd& end);
+    // 表决并上报一次通行; final 为 false 时置信度不够返回 false, 继续攒结果
+    bool decidePass(Camera& camera, uint64_t pass, PassState& state, bool final);
+    // 通行已结束且结果到齐时表决并清理
+    void closePass(Camera& camera, std::map<uint64_t, PassState>::iterator it);
+    // 处理各 OCR 线程的结果和各路的通行结束通知, 有处理任何一项时返回 true
+    bool drainQueues();
+    void stop();
+    static PipelineStats snapshot(const Counters& counters);
+    void printStats();
+};
@@ -0,0 +1,97 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <curl/curl.h>
+#include <nlohmann/json.hpp>
+
+// 待上报的一条进出场事件, captureTime 为识别到车牌时的本地时间 (epoch 秒)
+struct PlateEvent {
+    std::string plate;
+    std::string action;
+    int64_t captureTime = 0;
+    // 幂等键, 重试时保持不变, 服务器据此识别重复请求
+    std::string eventId;
+};
+
+struct SenderStats {
+    uint64_t sent = 0;
+    uint64_t failed = 0;
+    uint64_t retries = 0;
+    uint64_t dropped = 0;
+    uint64_t spooled = 0;
+    size_t queued = 0;
+    // 最近若干次成功请求的耗时 (毫秒)
+    double p50 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+// 后台发送线程: 帧处理循环只把事件放进有界队列, 由发送线程用一个长连接依次上报
+// 服务器不可达时事件追加到本地暂存文件, 恢复后按原顺序分批补发, 补发期间的新事件也先写入暂存文件
+class EventSender {
+public:
+    EventSender(const std::string& ip, int port, const std::string& token,
+                const std::string& spoolPath, size_t capacity = 256);
+    ~EventSender();
+
+    bool start();
+    // 队列已满时丢弃并返回 false
+    bool enqueue(const std::string& plate, const std::string& action);
+    SenderStats stats();
+
+private:
+    static const int BACKOFF_BASE_MS = 200;
+    static const int BACKOFF_MAX_MS = 5000;
+    static const size_t REPLAY_BATCH = 100;
+    static const size_t LATENCY_SAMPLES = 1024;
+    static const uint64_t STATS_INTERVAL = 100;
+
+    std::string baseUrl;
+    std::string token;
+    size_t capacity;
+
+    CURL* curl = nullptr;
+    curl_slist* headers = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<PlateEvent> queue;
+    bool stopping = false;
+    std::thread thread;
+
+    // 暂存文件每行一个事件, 已补发到的位置记录在 <spoolPath>.pos; 以下只由发送线程访问
+    std::string spoolPath;
+    int spoolFd = -1;
+    uint64_t spoolPos = 0;
+    bool spooling = false;
+    int backoffMs = BACKOFF_BASE_MS;
+    std::chrono::steady_clock::time_point nextReplay;
+
+    std::mutex statsMutex;
+    SenderStats counters;
+    std::vector<double> latencies;
+    size_t latencyPos = 0;
+    uint64_t eventSeq = 0;
+
+    void run();
+    bool request(const std::string& path, const std::string& body, std::string& response, bool& retryable);
+    // 返回 true 表示服务器已处理 (包括业务失败), false 表示失败; retryable 表示稍后可以重试 (包括服务器落盘失败)
+    bool post(const PlateEvent& event, bool& retryable);
+    bool openSpool();
+    bool appendSpool(const PlateEvent& event);
+    void saveSpoolPos();
+    // 补发一批暂存事件; 全部补发完后清空暂存文件
+    enum class Replay { Failed, Progress, Drained };
+    Replay replaySpool();
+    size_t replayBatch(const nlohmann::json& events);
+    size_t replayEach(const nlohmann::json& events);
+    void recordLatency(double ms);
+    void printStats();
+};
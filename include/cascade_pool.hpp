@@ -0,0 +1,26 @@
+#pragma once
+#include "plate_recognizer.hpp"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// 级联分类器池: 多路摄像头的检测线程共用几个分类器, 整帧检测时借用一个, 用完归还
+// 全部被占用时按先来后到等待, 各路摄像头轮流取得
+class CascadePool {
+public:
+    bool load(size_t count);
+    size_t size() const { return classifiers.size(); }
+
+    void detect(const cv::Mat& gray, std::vector<cv::Rect>& plates);
+
+private:
+    std::mutex mutex;
+    std::condition_variable available;
+    std::vector<std::unique_ptr<cv::CascadeClassifier>> classifiers;
+    std::vector<cv::CascadeClassifier*> idle;
+    // 排队号: 只有轮到的线程才能取走空闲的分类器
+    uint64_t nextTicket = 0;
+    uint64_t serving = 0;
+};
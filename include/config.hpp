@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <map>
+
+// 计费规则, 加载后只读; 修改配置时整体替换为新对象
+struct FeeConfig {
+    int freeTime = 0;
+    int stageTime = 60;
+    double stagePrice = 0.0;
+    double dayTop = 0.0;
+};
+
+class Config {
+public:
+    static Config& getInstance();
+
+    // 读取 config.json 中的计费规则, 解析失败时保留原有配置
+    bool loadFeeConfig();
+    std::shared_ptr<const FeeConfig> getFeeConfig() const;
+
+    // 监听运行目录下文件的修改, 文件被写入或替换后调用回调
+    void onFileChange(const std::string& filename, std::function<void()> callback);
+    bool startWatching();
+
+private:
+    Config() = default;
+    ~Config();
+
+    std::shared_ptr<const FeeConfig> feeConfig;
+
+    std::mutex callbacksMutex;
+    std::map<std::string, std::function<void()>> callbacks;
+    int inotifyFd = -1;
+    std::atomic<bool> stopWatching{false};
+    std::thread watchThread;
+
+    void watchLoop();
+};
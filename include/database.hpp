@@ -1,24 +1,157 @@
 #pragma once
 #include <nlohmann/json.hpp>
+#include "history.hpp"
 #include <string>
+#include <string_view>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <memory>
 #include <fstream>
+#include <cstdint>
 
 using json = nlohmann::json;
 
+// 单辆车的状态, 时间均为 epoch 秒, 0 表示没有
+struct VehicleRecord {
+    int64_t entryTime = 0;
+    int64_t monthlyExpiry = 0;
+    uint8_t inside : 1;
+    uint8_t monthly : 1;
+    uint8_t blacklisted : 1;
+
+    VehicleRecord() : inside(0), monthly(0), blacklisted(0) {}
+};
+
+// 用户目录, 加载后只读; users.json 修改时整体替换为新对象
+struct UserInfo {
+    std::string auth;
+    std::string role;
+};
+
+struct UserDirectory {
+    std::unordered_map<std::string, UserInfo> byName;
+    // bot 密钥 -> 用户名
+    std::unordered_map<std::string, std::string> botsByToken;
+};
+
 class Database {
 public:
     static Database& getInstance();
     json getUsers();
     bool saveUsers(const json& data);
-    json getVehicles();
-    bool saveVehicles(const json& data);
+
+    // 读取 users.json 建立用户目录, 解析失败时保留原有目录
+    bool loadUsers();
+    bool findUser(const std::string& username, UserInfo& out);
+    bool findBotByToken(const std::string& token, std::string& username);
+
+    // 车辆数据常驻内存: 启动时加载快照并重放预写日志, 之后每次修改只追加一条日志记录
+    bool loadVehicles();
+    std::vector<std::string> getPlates();
+    bool getVehicle(const std::string& plate, VehicleRecord& out);
+    // event 不为 None 时同时把该事件写入 HistoryLog
+    bool saveVehicle(const std::string& plate, const VehicleRecord& record,
+                     VehicleEvent event = VehicleEvent::None, int64_t eventTime = 0, double fee = 0.0);
+    // 写一次快照并轮换日志; 与后台快照线程互斥, 同一时间只有一个快照在写; 不能在持有车牌锁时调用
+    bool snapshotVehicles();
+    // 停止快照线程并关闭日志, 之后不能再修改车辆数据; 析构时自动调用
+    void close();
+
+    // 在场车辆索引, 随入场/出场增量维护
+    std::vector<std::string> getInsidePlates();
+    size_t getInsideCount() const;
+    // 全量扫描核对在场索引, 不一致时重建并返回 false; 不能在持有车牌锁时调用
+    bool verifyInsideIndex();
+
+    // 车牌锁: 对同一车牌的读-改-写需在持有该锁时进行, 不同车牌按哈希分到不同条带互不阻塞
+    // 可重入, 接口层可以在调用 VehicleManager 前先持有该锁
+    std::unique_lock<std::recursive_mutex> lockPlate(const std::string& plate);
+    // 一次锁住多个车牌所在的条带
+    std::vector<std::unique_lock<std::recursive_mutex>> lockPlates(const std::vector<std::string>& plates);
+
+    // 批量提交: beginBatch 之后当前线程的 saveVehicle 只修改内存并缓存日志记录,
+    // commitBatch 把整批记录一次写入并落盘; 调用方在整个批次期间需持有涉及车牌的锁; 可嵌套
+    void beginBatch();
+    bool commitBatch();
+    struct PendingBatch;
+
+    // 幂等键: 保存最近处理过的请求的响应, 重复请求直接返回原响应
+    // 随预写日志和快照持久化; 查询和保存应在持有相关车牌锁时进行, 保证重复请求不会同时执行
+    bool findResponse(const std::string& key, std::string& response);
+    bool saveResponse(const std::string& key, const std::string& response);
 
 private:
     Database() = default;
+    ~Database();
+    static const size_t SHARD_COUNT = 64;
+
+    // 每个分片按列存储: 车牌字符串只保存一份, 标志位和两个时间各占一列, 都用分片内槽位下标访问
+    // 核对在场索引只扫描标志列; 槽位只在内存中使用, 落盘的车牌 ID 由 HistoryLog 的车牌字典分配
+    enum : uint8_t { FLAG_INSIDE = 1, FLAG_MONTHLY = 2, FLAG_BLACKLISTED = 4 };
+    struct Shard {
+        std::mutex mutex;
+        std::deque<std::string> plates;
+        std::unordered_map<std::string_view, uint32_t> slots;
+        std::vector<uint8_t> flags;
+        std::vector<int64_t> entryTimes;
+        std::vector<int64_t> monthlyExpiries;
+        std::unordered_set<uint32_t> inside;
+    };
+
     std::mutex usersMutex;
-    std::mutex vehiclesMutex;
+    std::shared_ptr<const UserDirectory> userDirectory;
+    std::recursive_mutex plateLocks[SHARD_COUNT];
+    Shard shards[SHARD_COUNT];
+    std::atomic<size_t> insideCount{0};
+
+    // 幂等表, 超出容量时淘汰最早的键
+    std::mutex responsesMutex;
+    std::deque<std::string> responseOrder;
+    std::unordered_map<std::string, std::string> responses;
+
+    std::mutex walMutex;
+    int walFd = -1;
+    size_t walRecords = 0;
+    // 写入失败且无法截掉残缺记录时置位, 之后的写入一律失败, 直到快照换上新日志
+    bool walFailed = false;
+
+    // 写入 HistoryLog 失败的事件及其在该车牌历史中的序号, 按发生顺序保存
+    // 同一车牌之后的事件要等它们补写成功后才写入, 保证序号与位置一致; 快照删除旧日志前先全部补写
+    std::mutex historyRetryMutex;
+    std::vector<std::pair<PendingEvent, size_t>> failedHistory;
+
+    // 整个快照过程持有, 保证临时文件和轮换出去的日志不会被两个快照同时读写
+    std::mutex snapshotWriteMutex;
+    std::mutex snapshotMutex;
+    std::condition_variable snapshotCv;
+    bool snapshotRequested = false;
+    bool snapshotStop = false;
+    std::thread snapshotThread;
 
     json readJson(const std::string& filename);
     bool writeJson(const std::string& filename, const json& data);
-};
\ No newline at end of file
+    size_t shardIndex(const std::string& plate) const;
+    uint32_t internPlate(Shard& shard, const std::string& plate);
+    void applyRecord(Shard& shard, uint32_t slot, const VehicleRecord& record);
+    static VehicleRecord loadRecord(const Shard& shard, uint32_t slot);
+    static void storeRecord(Shard& shard, uint32_t slot, const VehicleRecord& record);
+    void loadVehicleJson(const std::string& plate, const json& v, std::map<std::string, json>* legacyHistory);
+    size_t replayWal(const std::string& filename, std::map<std::string, json>* legacyHistory);
+    void importLegacyHistory(const std::map<std::string, json>& legacyHistory);
+    bool checkInsideLocked();
+    void rememberResponse(const std::string& key, const std::string& response);
+    bool appendWal(const std::string& data, size_t records);
+    // 该车牌下一个事件的序号, 包括尚未补写成功的事件
+    size_t nextHistoryIndex(const std::string& plate);
+    // 补写失败的事件, plate 为空时补写全部; 该车牌 (或全部) 都补写成功时返回 true
+    bool retryHistory(const std::string* plate);
+    void recordFailedHistory(const PendingEvent& event, size_t index);
+    void snapshotLoop();
+};
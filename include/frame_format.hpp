@@ -0,0 +1,16 @@
+#pragma once
+#include <string>
+#include <opencv2/opencv.hpp>
+
+// 输入帧的像素格式, 名称与 ffmpeg 的 -pix_fmt 一致
+enum class PixelFormat { BGR24, RGB24, GRAY, YUYV422 };
+
+bool parsePixelFormat(const std::string& name, PixelFormat& format);
+int bytesPerPixel(PixelFormat format);
+// 对应的 cv::Mat 类型, 用于直接包装读到的原始数据
+int frameMatType(PixelFormat format);
+
+// 转为单通道灰度图; GRAY 格式不复制
+void frameToGray(const cv::Mat& frame, PixelFormat format, cv::Mat& gray);
+// 转为 BGR, 仅用于显示; BGR24 格式不复制
+void frameToBgr(const cv::Mat& frame, PixelFormat format, cv::Mat& bgr);
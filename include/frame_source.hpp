@@ -0,0 +1,52 @@
+#pragma once
+#include "frame_format.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// 一帧原始数据; data 指向 storage 或来源自己的只读内存 (如文件映射), 之后各级都不再复制
+struct FrameBuffer {
+    uint64_t seq = 0;
+    const unsigned char* data = nullptr;
+    std::vector<unsigned char> storage;
+};
+
+// 帧来源: 管道/设备、映射的原始视频文件或 VideoCapture 能打开的视频
+// read/skip 只由读帧线程调用; 等待输入时定期检查 stop, 为 true 时返回 false
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    virtual bool open() = 0;
+    // 读下一帧; 输入结束或出错时返回 false
+    virtual bool read(FrameBuffer& frame, const std::atomic<bool>& stop) = 0;
+    // 跳过下一帧, 不需要的帧不做解码或复制
+    virtual bool skip(const std::atomic<bool>& stop) = 0;
+    // 实时来源处理不过来时可以丢帧; 文件来源应等待, 保证每帧都处理
+    virtual bool live() const = 0;
+    // 为 true 时 read 不使用 FrameBuffer::storage, 不必预分配
+    virtual bool zeroCopy() const { return false; }
+
+    // open 之后的画面尺寸和像素格式; 视频文件由文件本身决定
+    int width() const { return frameWidth; }
+    int height() const { return frameHeight; }
+    PixelFormat format() const { return pixelFormat; }
+    size_t frameSize() const
+    {
+        return static_cast<size_t>(frameWidth) * frameHeight * bytesPerPixel(pixelFormat);
+    }
+
+protected:
+    int frameWidth = 0;
+    int frameHeight = 0;
+    PixelFormat pixelFormat = PixelFormat::BGR24;
+};
+
+// type 为 "raw" 时 path 是原始帧数据: "-" 表示标准输入, 普通文件整体映射到内存, 管道和设备用 read() 读取;
+// type 为 "capture" 时用 VideoCapture 打开, 输出 bgr24, 尺寸取自视频本身
+// 失败时输出原因并返回空指针
+std::unique_ptr<FrameSource> openFrameSource(const std::string& type, const std::string& path,
+                                             int width, int height, PixelFormat format);
@@ -0,0 +1,92 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include <cstdint>
+#include <sys/types.h>
+
+// 进出场事件类型
+enum class VehicleEvent : uint8_t { None = 0, Entry = 1, Exit = 2 };
+
+// 历史事件在分段文件中的定长记录
+struct HistoryEvent {
+    uint32_t plateId;
+    uint8_t type;
+    uint8_t reserved[3];
+    int64_t time;
+    double fee;
+};
+static_assert(sizeof(HistoryEvent) == 24, "HistoryEvent must stay 24 bytes on disk");
+
+// 待写入的事件, 用于批量追加
+struct PendingEvent {
+    std::string plate;
+    VehicleEvent type;
+    int64_t time;
+    double fee;
+};
+
+// 只追加的分段历史日志: history/NNNNNN.seg 按到达顺序保存定长事件, history/plates.dat 保存车牌字典
+// 内存中为每个车牌维护其事件序号列表, 按车牌分页查询只读取需要的记录
+class HistoryLog {
+public:
+    static HistoryLog& getInstance();
+
+    bool open(const std::string& dir);
+    bool empty();
+    bool append(const std::string& plate, VehicleEvent type, int64_t time, double fee);
+    // 按顺序追加多条事件, 整批只落盘一次
+    bool appendBatch(const std::vector<PendingEvent>& events);
+    // 日志重放时使用: index 为该事件在此车牌历史中的序号, 已经写入过则跳过
+    bool ensure(const std::string& plate, size_t index, VehicleEvent type, int64_t time, double fee);
+
+    size_t count(const std::string& plate);
+    // 从 cursor (该车牌的第几条事件) 开始按时间顺序取 [from, to] 内的事件, 最多 limit 条
+    // nextCursor 为下一页起点, 没有更多数据时等于该车牌事件总数
+    std::vector<HistoryEvent> query(const std::string& plate, int64_t from, int64_t to,
+                                    size_t limit, size_t cursor, size_t& nextCursor);
+    // 该车牌最近的 limit 条事件
+    std::vector<HistoryEvent> recent(const std::string& plate, size_t limit);
+
+    // 按时间范围查询所有车辆的事件, type 为 None 时不过滤类型
+    // 结果按时间排序, 跳过前 cursor 条匹配事件后最多返回 limit 条, more 表示后面还有
+    std::vector<std::pair<std::string, HistoryEvent>> queryRange(int64_t from, int64_t to, VehicleEvent type,
+                                                                 size_t limit, size_t cursor, bool& more);
+
+private:
+    HistoryLog() = default;
+    ~HistoryLog();
+    static const uint64_t SEGMENT_EVENTS = 1 << 16;
+
+    std::shared_mutex mutex;
+    std::string dir;
+    int platesFd = -1;
+    // 字典文件中已提交的长度, 新车牌写在这里
+    off_t platesSize = 0;
+    std::vector<int> segmentFds;
+    uint64_t eventCount = 0;
+
+    std::unordered_map<std::string, uint32_t> plateIds;
+    std::vector<std::string> plateNames;
+    std::vector<std::vector<uint64_t>> plateEvents;
+
+    // 全局时间索引: 日志每 BLOCK_EVENTS 条事件为一块, 内存中只保存各块的时间范围
+    // 事件基本按时间到达, prefixMax (该块及之前各块的最晚时间) 单调不减, 可二分找到第一个可能相关的块
+    static const uint64_t BLOCK_EVENTS = 256;
+    struct TimeBlock {
+        int64_t minTime;
+        int64_t maxTime;
+        int64_t prefixMax;
+    };
+    std::vector<TimeBlock> blocks;
+
+    std::string segmentPath(size_t segment) const;
+    bool openSegment(size_t segment);
+    bool readEvent(uint64_t seq, HistoryEvent& event);
+    void indexEvent(const HistoryEvent& event, uint64_t seq);
+    bool internLocked(const std::string& plate, bool sync, uint32_t& id);
+    void dropPlatesLocked(size_t count, off_t size);
+    bool commitEventsLocked(const std::vector<HistoryEvent>& events);
+    bool appendLocked(const std::string& plate, VehicleEvent type, int64_t time, double fee);
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <cstdint>
+
+// 操作日志的存储: 当前日志追加写入 system.log, 达到大小或时长上限后轮换到 logs/NNNNNN.log.gz
+// 每个已关闭的分段旁边有 NNNNNN.idx, 记录时间范围和涉及的车牌/用户, 查询时先用它排除无关分段
+// 写入只由 Logger 的后台线程调用, 查询可在任意线程进行; 轮换出的分段由单独的压缩线程压缩, 不阻塞写入
+class LogStore {
+public:
+    LogStore() = default;
+    ~LogStore();
+
+    bool open(const std::string& activeFile, const std::string& dir);
+    void setRotation(uint64_t maxBytes, int64_t maxSeconds);
+
+    // 把一条日志记录加入当前批次, line 为它的单行格式
+    void add(const nlohmann::json& log, const std::string& line);
+    // 写出当前批次, 需要时轮换分段
+    void commit();
+
+    // 按条件查询日志记录, 空字符串表示不过滤; 结果按写入顺序, 跳过 cursor 条后最多 limit 条
+    std::vector<nlohmann::json> query(const std::string& plate, const std::string& user, int64_t from, int64_t to,
+                                      size_t limit, size_t cursor, bool& more);
+
+private:
+    struct SegmentIndex {
+        std::string path;
+        int64_t from = 0;
+        int64_t to = 0;
+        uint64_t records = 0;
+        std::unordered_set<std::string> plates;
+        std::unordered_set<std::string> users;
+
+        void note(int64_t time, const std::string& plate, const std::string& user);
+        bool matches(const std::string& plate, const std::string& user, int64_t from, int64_t to) const;
+    };
+
+    std::string activeFile;
+    std::string dir;
+    uint64_t maxBytes = 64ull << 20;
+    int64_t maxSeconds = 86400;
+
+    // 以下只由写线程访问
+    int fd = -1;
+    uint64_t activeBytes = 0;
+    int64_t activeOpened = 0;
+    size_t nextSegment = 0;
+    std::string batch;
+
+    // 分段列表和当前分段的索引, 查询和轮换互斥
+    std::mutex mutex;
+    std::vector<SegmentIndex> segments;
+    SegmentIndex active;
+
+    // 等待压缩的分段 (编号和索引), 由压缩线程依次处理; 未压缩完就退出的分段下次启动时重做
+    std::mutex compressMutex;
+    std::condition_variable compressReady;
+    std::deque<std::pair<size_t, SegmentIndex>> compressQueue;
+    bool compressStopping = false;
+    std::thread compressor;
+
+    std::string segmentPath(size_t segment, const char* suffix) const;
+    bool openActive();
+    void rotate(int64_t now);
+    void scheduleClose(size_t segment, const SegmentIndex& index);
+    void compressLoop();
+    bool closeSegment(size_t segment, const SegmentIndex& index);
+    static void recordKeys(const nlohmann::json& log, int64_t& time, std::string& plate, std::string& user);
+    static bool scanFile(const std::string& path, const std::function<void(const std::string&)>& onLine);
+    static bool indexFile(const std::string& path, SegmentIndex& index);
+    static bool compressFile(const std::string& src, const std::string& dst);
+    static bool saveIndex(const std::string& path, const SegmentIndex& index);
+    static bool loadIndex(const std::string& path, SegmentIndex& index);
+};
@@ -1,15 +1,46 @@
 #pragma once
 #include <string>
-#include <mutex>
+#include <cstdint>
+#include <vector>
 #include <nlohmann/json.hpp>
 
+// 控制台输出级别: 关闭 / 单行 / 缩进排版
+enum class LogStdout { Off, Compact, Pretty };
+// 缓冲区满时的处理: 等待空位 / 丢弃新记录 (丢弃数会写入日志)
+enum class LogOverflow { Block, Drop };
+
 class Logger {
 public:
     static void logUser(const std::string& username, const std::string& action, const std::string& message);
     static void logVehicle(const std::string& plate, const std::string& action, const std::string& message);
     static void logAdmin(const std::string& admin, const std::string& action, const std::string& plate, const std::string& message);
 
+    // 读取 config.json 中可选的 "log" 配置:
+    // {"stdout": "off|compact|pretty", "overflow": "block|drop", "rotate_bytes": N, "rotate_seconds": N}
+    static void configure(const nlohmann::json& config);
+    static void setStdout(LogStdout level);
+    static void setOverflow(LogOverflow policy);
+    // 因缓冲区满被丢弃的记录数
+    static uint64_t droppedCount();
+    // 等待已提交的记录全部写出
+    static void flush();
+
+    // 审计查询: 按车牌、操作者 (空字符串表示不限) 和时间范围查找日志记录, 只打开索引匹配的分段
+    static std::vector<nlohmann::json> queryAudit(const std::string& plate, const std::string& user, int64_t from, int64_t to,
+                                                  size_t limit, size_t cursor, bool& more);
+
 private:
-    static std::mutex logMutex;
-    static void writeLog(const nlohmann::json& log);
-};
\ No newline at end of file
+    enum Kind : uint8_t { User, Vehicle, Admin };
+    struct Record {
+        int64_t time = 0;
+        Kind kind = User;
+        std::string user;
+        std::string plate;
+        std::string action;
+        std::string message;
+    };
+    class Worker;
+
+    static Worker& worker();
+    static nlohmann::json toJson(const Record& record);
+};
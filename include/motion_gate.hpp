@@ -0,0 +1,27 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+
+// 运动检测: 把灰度画面缩小, 与上次运行车牌检测时的画面比较,
+// 变化的像素比例达到阈值才需要重新检测; 与上次检测比较而不是与上一帧比较, 缓慢移动也能累积出来
+class MotionGate {
+public:
+    // threshold 为变化像素比例, 0 表示每帧都检测; pixelThreshold 为单个像素灰度差的阈值
+    // 连续 maxSkip 帧没有变化时也检测一次, 防止光线缓慢变化后一直沿用旧结果; 0 表示不强制
+    MotionGate(double threshold = 0.005, int pixelThreshold = 25, int maxSkip = 30, int scale = 8);
+
+    // gray 为单通道灰度图; 返回 true 表示需要运行车牌检测
+    bool changed(const cv::Mat& gray);
+    // 最近一次比较时变化像素的比例
+    double lastChange() const { return change; }
+
+private:
+    double threshold;
+    int pixelThreshold;
+    int maxSkip;
+    int scale;
+    int skipped = 0;
+    double change = 1.0;
+    cv::Mat reference;
+    cv::Mat small;
+    cv::Mat diff;
+};
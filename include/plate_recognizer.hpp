@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// OpenCV
+#include <opencv2/opencv.hpp>
+
+// Tesseract OCR
+#include <tesseract/baseapi.h>
+
+// 车牌 OCR 设置
+struct OcrOptions {
+    // Tesseract 语言模型
+    std::string language = "eng";
+    // 只在这些字符中识别, 空表示不限制; 包含服务器保存的车牌中的分隔符 '-'
+    std::string whitelist = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-";
+    // 识别结果需整体匹配的车牌格式 (ECMAScript 正则), 空表示不校验; 默认与服务器中的车牌 (如 "AB-01-01") 一致
+    std::string platePattern = "[A-Z]{2}-[0-9]{2}-[0-9]{2}";
+};
+
+// 各步骤耗时 (毫秒), 传入的函数把本次耗时累加上去; 用于性能测试
+struct PlateTimings {
+    double convert = 0.0;
+    double equalize = 0.0;
+    double detect = 0.0;
+    double threshold = 0.0;
+    double ocr = 0.0;
+};
+
+// 加载车牌级联模型
+bool loadPlateCascade(cv::CascadeClassifier& plateCascade);
+// 初始化一个车牌用的 OCR 引擎: 单行识别, 只认字符白名单, 不用词典
+// TessBaseAPI 不是线程安全的, 每个线程各用一个, 初始化一次后反复使用
+bool initOcr(tesseract::TessBaseAPI& ocr, const OcrOptions& options = OcrOptions());
+
+// 转为均衡化后的灰度图, 检测、跟踪和识别都使用这张图
+void preparePlateGray(const cv::Mat& frame, cv::Mat& gray, PlateTimings* timings = nullptr);
+// 在灰度图上整帧检测车牌区域
+void detectPlates(cv::CascadeClassifier& plateCascade, const cv::Mat& gray, std::vector<cv::Rect>& plates);
+
+// 处理车牌图像: 转灰度并检测车牌区域
+bool processPlatesImages(const cv::Mat& frame, cv::CascadeClassifier& plateCascade,
+                         std::vector<cv::Rect>& plates, cv::Mat& gray, PlateTimings* timings = nullptr);
+
+// 识别单个车牌区域 (灰度图), 返回去掉空白后的文字, 识别不出时为空
+// confidence 不为空时写入 Tesseract 的平均置信度 (0~100)
+std::string recognizePlate(tesseract::TessBaseAPI& ocr, const cv::Mat& plateROI, int* confidence = nullptr,
+                           PlateTimings* timings = nullptr);
+
+// 获取车牌字符串, 同时在 frame 上框出车牌
+bool getPlate(const std::vector<cv::Rect>& plates,
+              std::vector<std::string>& plateStrings,
+              tesseract::TessBaseAPI& ocr,
+              cv::Mat& frame,
+              const cv::Mat& gray,
+              PlateTimings* timings = nullptr);
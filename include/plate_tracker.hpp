@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// 在相邻帧之间跟踪车牌区域: 以检测时的车牌图像为模板, 只在原位置周围的搜索窗口内做模板匹配,
+// 代替整帧级联检测; 匹配分数低于阈值即视为跟丢, 由调用方重新整帧检测
+class PlateTracker {
+public:
+    explicit PlateTracker(double minScore = 0.6);
+
+    // 用一次整帧检测的结果重新开始跟踪, plates 为空时停止跟踪
+    void reset(const cv::Mat& gray, const std::vector<cv::Rect>& plates);
+    // 更新全部车牌的位置; 任一车牌跟丢时返回 false, 此时 plates 的内容无效
+    bool update(const cv::Mat& gray, std::vector<cv::Rect>& plates);
+    bool empty() const { return tracks.empty(); }
+    // 最近一次更新中最低的匹配分数
+    double lastScore() const { return score; }
+
+private:
+    // 搜索窗口在车牌四周各扩展车牌宽高的一半, 但不少于这么多像素
+    static const int MIN_MARGIN = 16;
+
+    struct Track {
+        cv::Mat templ;
+        cv::Rect rect;
+    };
+
+    double minScore;
+    double score = 0.0;
+    std::vector<Track> tracks;
+    cv::Mat result;
+};
@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// 多帧投票: 同一次通行的多次识别结果先按长度、再按字符位置加权多数表决, 权重为 OCR 置信度
+class PlateVote {
+public:
+    // confidence 为 Tesseract 给出的 0~100 的平均置信度
+    void add(const std::string& text, int confidence);
+    size_t size() const { return samples.size(); }
+    bool empty() const { return samples.empty(); }
+    void clear() { samples.clear(); }
+
+    // 返回表决结果; confidence 为各位置胜出字符的平均得票比例乘以胜出长度的得票比例 (0~1)
+    std::string result(double& confidence) const;
+
+private:
+    struct Sample {
+        // 按 UTF-8 字符拆开
+        std::vector<std::string> chars;
+        double weight = 1.0;
+    };
+
+    std::vector<Sample> samples;
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+// 有界单生产者单消费者队列: 只允许一个线程 push、一个线程 pop, 不加锁
+// 队列满或空时立即返回 false, 由调用方决定等待还是丢弃
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : slots(capacity + 1) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // 失败时 value 保持不变
+    bool tryPush(T&& value)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t n = next(t);
+        if (n == head.load(std::memory_order_acquire)) return false;
+        slots[t] = std::move(value);
+        tail.store(n, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& value)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        value = std::move(slots[h]);
+        slots[h] = T();
+        head.store(next(h), std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const
+    {
+        size_t h = head.load(std::memory_order_acquire);
+        size_t t = tail.load(std::memory_order_acquire);
+        return t >= h ? t - h : t + slots.size() - h;
+    }
+
+    size_t capacity() const { return slots.size() - 1; }
+
+private:
+    std::vector<T> slots;
+    // 读写位置分开放在不同缓存行, 避免生产者和消费者互相失效
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+
+    size_t next(size_t i) const { return i + 1 == slots.size() ? 0 : i + 1; }
+};
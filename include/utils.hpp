@@ -1,10 +1,19 @@
 #pragma once
 #include <string>
 #include <ctime>
+#include <cstdint>
+#include <cstddef>
 
 namespace utils {
     std::string sha256(const std::string& input);
     std::string getCurrentTimeISO();
-    time_t isoStringToTime(const std::string& iso);
-    double calculateHours(const std::string& start, const std::string& end);
-}
\ No newline at end of file
+
+    // 内部统一使用 epoch 秒; 以下函数只在 API 边界与本地时间字符串互转, 不分配内存也不加锁
+    int64_t nowEpoch();
+    // 解析 "YYYY-MM-DDTHH:MM:SS", 日期与时间之间也可以是空格; 长度必须恰好 19, 日期必须存在 (如不接受 2 月 30 日)
+    bool parseTime(const char* s, size_t len, int64_t& out);
+    bool parseTime(const std::string& s, int64_t& out);
+    // 写入 "YYYY-MM-DDTHH:MM:SS" 共 19 个字符并以 '\0' 结尾, buf 至少 20 字节
+    void formatTime(int64_t epoch, char* buf);
+    std::string formatTime(int64_t epoch);
+}
@@ -1,12 +1,32 @@
 #pragma once
 #include <string>
+#include <cstdint>
+#include <vector>
+#include "history.hpp"
 
+// 批量接口中的一条进出场事件及其处理结果
+struct GateEvent {
+    std::string plate;
+    VehicleEvent action = VehicleEvent::None;
+    int64_t time = 0;
+};
+
+struct GateResult {
+    bool success = false;
+    std::string msg;
+    double fee = 0.0;
+    std::string duration;
+};
+
+// 时间参数均为 epoch 秒, 字符串格式只在 HTTP 接口处转换
 class VehicleManager {
 public:
-    static bool entry(const std::string& plate, const std::string& time, std::string& msg);
-    static bool exit(const std::string& plate, const std::string& time, double& fee, std::string& duration, std::string& msg);
+    static bool entry(const std::string& plate, int64_t time, std::string& msg);
+    static bool exit(const std::string& plate, int64_t time, double& fee, std::string& duration, std::string& msg);
     static bool addMonthly(const std::string& plate, int days, std::string& msg);
     static bool addBlacklist(const std::string& plate, std::string& msg);
     static bool removeBlacklist(const std::string& plate, std::string& msg);
-    static bool getDuration(const std::string& plate, const std::string& time, std::string& duration, double& fee, std::string& msg);
-};
\ No newline at end of file
+    // 按顺序处理一批事件, 全部修改只落盘一次; 提交失败时返回 false, 原本成功的结果改为数据库错误
+    static bool applyBatch(const std::vector<GateEvent>& events, std::vector<GateResult>& results);
+    static bool getDuration(const std::string& plate, int64_t time, std::string& duration, double& fee, std::string& msg);
+};
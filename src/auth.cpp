@@ -4,6 +4,14 @@
 #include <random>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
+#include <chrono>
+
+// 会话到期使用单调时钟, 不受系统时间调整影响
+static int64_t monotonicSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 // 该函数使用单例模式确保全局只有一个 Auth 实例
 Auth& Auth::getInstance() {
@@ -11,6 +19,23 @@ Auth& Auth::getInstance() {
     return instance;
 }
 
+Auth::~Auth() {
+    {
+        std::lock_guard<std::mutex> lock(reaperMutex);
+        reaperStop = true;
+        reaperCv.notify_one();
+    }
+    if (reaperThread.joinable()) reaperThread.join();
+}
+
+Auth::Shard& Auth::shardFor(const std::string& token) {
+    return shards[std::hash<std::string>{}(token) % SHARD_COUNT];
+}
+
+void Auth::setSessionTtl(int64_t seconds) {
+    if (seconds > 0) ttl = seconds;
+}
+
 // 生成随机的临时认证令牌
 std::string Auth::generateToken() {
     std::random_device rd;
@@ -26,60 +51,124 @@ std::string Auth::generateToken() {
 
 // 验证用户登录信息
 bool Auth::loginUser(const std::string& username, const std::string& password, std::string& token, std::string& role) {
-    auto& db = Database::getInstance();
-    auto users = db.getUsers();
-
-    // 查找用户
-    for (const auto& user : users) {
-        if (user["username"] == username) {
-            std::string storedAuth = user["auth"];
-            std::string userRole = user["role"];
-
-            // bot用户直接比较密钥
-            if (userRole == "bot") {
-                if (password == storedAuth) {
-                    token = generateToken();
-                    {
-                        std::lock_guard<std::mutex> lock(tokensMutex);
-                        tokens[token] = {userRole, username};
-                    }
-                    role = userRole;
-                    return true;
-                }
-            } else {
-                // 对用户密码进行 SHA256 哈希后再与存储的认证码比较
-                std::string inputHash = utils::sha256(password);
-                if (inputHash == storedAuth) {
-                    // 验证成功, 生成新的令牌, 并输出令牌及用户角色
-                    token = generateToken();
-                    {
-                        std::lock_guard<std::mutex> lock(tokensMutex);
-                        tokens[token] = {userRole, username};
-                    }
-                    role = userRole;
-                    return true;
-                }
+    UserInfo user;
+    if (!Database::getInstance().findUser(username, user)) {
+        return false;
+    }
+
+    // bot用户直接比较密钥, 其他用户对密码进行 SHA256 哈希后再与存储的认证码比较
+    bool valid = user.role == "bot" ? password == user.auth : utils::sha256(password) == user.auth;
+    if (!valid) {
+        return false;
+    }
+
+    // 验证成功, 生成新的令牌, 并输出令牌及用户角色
+    token = generateToken();
+    addSession(token, user.role, username);
+    role = user.role;
+    return true;
+}
+
+void Auth::addSession(const std::string& token, const std::string& role, const std::string& username) {
+    int64_t expiresAt = monotonicSeconds() + ttl;
+    {
+        auto& shard = shardFor(token);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        if (!shard.sessions.try_emplace(token, role, username, expiresAt).second) return;
+    }
+    activeSessions++;
+    createdSessions++;
+    schedule(token, expiresAt);
+}
+
+// 把令牌挂到到期时间所在的时间轮格子
+void Auth::schedule(const std::string& token, int64_t expiresAt) {
+    std::lock_guard<std::mutex> lock(wheelMutex);
+    int64_t tick = std::max(expiresAt / WHEEL_TICK, wheelTick + 1);
+    wheel[tick % WHEEL_SLOTS].push_back(token);
+}
+
+// 验证令牌的有效性, 只持有所在分片的读锁; 有效时顺延到期时间
+bool Auth::validateToken(const std::string& token, std::string& role, std::string& username) {
+    int64_t now = monotonicSeconds();
+    auto& shard = shardFor(token);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.sessions.find(token);
+    if (it == shard.sessions.end()) return false;
+    // 已过期但尚未被回收的令牌同样视为无效
+    if (it->second.expiresAt.load(std::memory_order_relaxed) <= now) return false;
+    it->second.expiresAt.store(now + ttl, std::memory_order_relaxed);
+    role = it->second.role;
+    username = it->second.username;
+    return true;
+}
+
+// 用户登出，移除指定的令牌; 时间轮中的残留项在到期时跳过
+void Auth::removeToken(const std::string& token) {
+    auto& shard = shardFor(token);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    if (shard.sessions.erase(token)) {
+        activeSessions--;
+        removedSessions++;
+    }
+}
+
+// 处理一格: 已过期的删除, 期间被顺延的按新的到期时间重新挂回时间轮
+void Auth::reapTick(int64_t tick) {
+    std::vector<std::string> due;
+    {
+        std::lock_guard<std::mutex> lock(wheelMutex);
+        due.swap(wheel[tick % WHEEL_SLOTS]);
+        wheelTick = tick;
+    }
+    int64_t now = monotonicSeconds();
+    for (const auto& token : due) {
+        int64_t expiresAt;
+        {
+            auto& shard = shardFor(token);
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            auto it = shard.sessions.find(token);
+            if (it == shard.sessions.end()) continue;
+            expiresAt = it->second.expiresAt.load(std::memory_order_relaxed);
+            if (expiresAt <= now) {
+                shard.sessions.erase(it);
+                activeSessions--;
+                expiredSessions++;
+                continue;
             }
-            break;
         }
+        schedule(token, expiresAt);
     }
-    return false;
 }
 
-// 验证令牌的有效性
-bool Auth::validateToken(const std::string& token, std::string& role, std::string& username) {
-    std::lock_guard<std::mutex> lock(tokensMutex);
-    auto it = tokens.find(token);
-    if (it != tokens.end()) {
-        role = it->second.first;
-        username = it->second.second;
-        return true;
+void Auth::reaperLoop() {
+    std::unique_lock<std::mutex> lock(reaperMutex);
+    while (!reaperStop) {
+        reaperCv.wait_for(lock, std::chrono::seconds(WHEEL_TICK));
+        if (reaperStop) break;
+        lock.unlock();
+        int64_t current = monotonicSeconds() / WHEEL_TICK;
+        int64_t last;
+        {
+            std::lock_guard<std::mutex> wheelLock(wheelMutex);
+            last = wheelTick;
+        }
+        // 最多转一圈, 之后的格子就是已经处理过的同一批
+        for (int64_t tick = std::max(last + 1, current - static_cast<int64_t>(WHEEL_SLOTS) + 1); tick <= current; ++tick) {
+            reapTick(tick);
+        }
+        lock.lock();
     }
-    return false;
 }
 
-// 用户登出，移除指定的令牌
-void Auth::removeToken(const std::string& token) {
-    std::lock_guard<std::mutex> lock(tokensMutex);
-    tokens.erase(token);
-}
\ No newline at end of file
+void Auth::startReaper() {
+    {
+        std::lock_guard<std::mutex> lock(wheelMutex);
+        wheelTick = monotonicSeconds() / WHEEL_TICK;
+    }
+    reaperThread = std::thread(&Auth::reaperLoop, this);
+}
+
+SessionStats Auth::getSessionStats() const {
+    return {activeSessions.load(), createdSessions.load(), expiredSessions.load(), removedSessions.load()};
+}
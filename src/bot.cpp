@@ -1,134 +1,89 @@
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <string>
-#include <chrono>
-#include <thread>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
 #include <curl/curl.h>
 #include <nlohmann/json.hpp>
-
-// OpenCV
-#include <opencv2/opencv.hpp>
-
-// Tesseract OCR
-#include <tesseract/baseapi.h>
-#include <leptonica/allheaders.h>
+#include "../include/bot_sender.hpp"
+#include "../include/bot_pipeline.hpp"
 
 using json = nlohmann::json;
 
-// 定义帧宽高
-#define FRAME_WIDTH 640
-#define FRAME_HEIGHT 480
+static PlatePipeline* activePipeline = nullptr;
 
-// cURL 回调函数
-static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp)
+static void handleSignal(int)
 {
-    std::string* str = (std::string*)userp;
-    size_t totalSize = size * nmemb;
-    str->append((char*)contents, totalSize);
-    return totalSize;
+    if (activePipeline) activePipeline->requestStop();
 }
 
-// HTTP 请求封装函数
-bool sendHttpPost(const std::string &ip, const int &port, const std::string &token, 
-                  const std::string &license_plate, const std::string &action)
+static void printUsage(const char* name)
 {
-    std::string url = "http://" + ip + ":" + std::to_string(port) + "/api/opencv/process";
-
-    // 构建JSON payload
-    json payload;
-    payload["token"] = token;
-    payload["license_plate"] = license_plate;
-    payload["action"] = action;
-
-    std::string payloadStr = payload.dump();
-
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        std::cerr << "无法初始化curl" << std::endl;
-        return false;
-    }
-
-    std::string response_string;
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payloadStr.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, payloadStr.size());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_string);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-
-    CURLcode res = curl_easy_perform(curl);
-    if (res != CURLE_OK) {
-        std::cerr << "请求失败: " << curl_easy_strerror(res) << std::endl;
-    }
-
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    return res == CURLE_OK;
+    std::cerr << "用法: " << name << " [--source 文件|-] [--capture 视频文件|摄像头编号|URL] [--headless]"
+              << " [--size 宽x高] [--pix-fmt bgr24|rgb24|gray|yuyv422] [--detect-width 宽]" << std::endl;
 }
 
-// 处理车牌图像
-bool processPlatesImages(const cv::Mat& frame, cv::CascadeClassifier& plateCascade, 
-                        std::vector<cv::Rect>& plates, cv::Mat& gray)
+// 命令行参数覆盖 config_bot.json 中的同名设置 (多路时作为各路的默认值)
+static bool parseArgs(int argc, char** argv, json& config)
 {
-    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
-    cv::equalizeHist(gray, gray);
-    plateCascade.detectMultiScale(gray, plates, 1.1, 10, 0, cv::Size(30, 30));
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--source" && hasValue) {
+            config["source_type"] = "raw";
+            config["source"] = argv[++i];
+        } else if (arg == "--capture" && hasValue) {
+            config["source_type"] = "capture";
+            config["source"] = argv[++i];
+        } else if (arg == "--headless") {
+            config["headless"] = true;
+        } else if (arg == "--size" && hasValue) {
+            int width = 0, height = 0;
+            if (std::sscanf(argv[++i], "%dx%d", &width, &height) != 2) return false;
+            config["width"] = width;
+            config["height"] = height;
+        } else if (arg == "--pix-fmt" && hasValue) {
+            config["pixel_format"] = argv[++i];
+        } else if (arg == "--detect-width" && hasValue) {
+            config["detect_width"] = std::atoi(argv[++i]);
+        } else {
+            return false;
+        }
+    }
     return true;
 }
 
-// 获取车牌字符串
-bool getPlate(const std::vector<cv::Rect>& plates, 
-            std::vector<std::string>& plateStrings,
-            tesseract::TessBaseAPI& ocr,
-            cv::Mat& frame,
-            const cv::Mat& gray)
+// cameras 中每一项未写的设置取顶层的同名设置; 没有 cameras 时顶层就是唯一的一路
+// spool_file 不继承: 各路必须各用一个暂存文件, 见 spoolPath
+static std::vector<json> cameraConfigs(const json& config)
 {
-    for (size_t i = 0; i < plates.size(); i++)
-    {
-        cv::rectangle(frame, plates[i], cv::Scalar(0, 255, 0), 2);
-        cv::Mat plateROI = gray(plates[i]);
-
-        cv::Mat thresh;
-        cv::threshold(plateROI, thresh, 0, 255, cv::THRESH_BINARY + cv::THRESH_OTSU);
-
-        ocr.SetImage(thresh.data, thresh.cols, thresh.rows, 1, thresh.step);
-        std::string plateText = std::string(ocr.GetUTF8Text());
-
-        std::istringstream iss(plateText);
-        std::string word, result;
-        while(iss >> word) {
-            result += word;
-        }
-        if (!result.empty()) {
-            plateStrings.push_back(result);
+    static const char* inherited[] = {"source", "source_type", "width", "height", "pixel_format",
+                                      "role", "token"};
+    std::vector<json> cameras;
+    if (!config.contains("cameras")) {
+        cameras.push_back(config);
+        return cameras;
+    }
+    for (const auto& entry : config["cameras"]) {
+        json camera = entry;
+        for (const char* key : inherited) {
+            if (!camera.contains(key) && config.contains(key)) camera[key] = config[key];
         }
+        cameras.push_back(camera);
     }
-    return true;
+    return cameras;
 }
 
-// 初始化OpenCV和Tesseract
-bool init(cv::CascadeClassifier &plateCascade, tesseract::TessBaseAPI &ocr, 
-         std::vector<unsigned char> &buffer)
+// 暂存文件路径; 多路时未单独设置的, 在顶层 spool_file (默认 bot_spool.log) 后加上 .名称
+static std::string spoolPath(const json& config, const json& camera, const std::string& name, bool multiple)
 {
-    const int FRAME_SIZE = FRAME_WIDTH * FRAME_HEIGHT * 3;
-    buffer.resize(FRAME_SIZE);
-    
-    if (!plateCascade.load("haarcascade_russian_plate_number.xml")) {
-        std::cerr << "加载车牌级联模型失败" << std::endl;
-        return false;
-    }
-
-    if (ocr.Init(nullptr, "eng", tesseract::OEM_LSTM_ONLY)) {
-        std::cerr << "无法初始化tesseract OCR" << std::endl;
-        return false;
-    }
-    ocr.SetPageSegMode(tesseract::PSM_SINGLE_BLOCK);
-    return true;
+    std::string base = config.value("spool_file", std::string("bot_spool.log"));
+    if (!multiple) return base;
+    return camera.value("spool_file", base + "." + name);
 }
 
 int main(int argc, char** argv)
@@ -146,65 +101,108 @@ int main(int argc, char** argv)
         std::cerr << "解析config_bot.json出错：" << e.what() << std::endl;
         return -1;
     }
+    if (!parseArgs(argc, argv, config)) {
+        printUsage(argv[0]);
+        return -1;
+    }
 
     std::string ip = config["ip"];
     int port = config["port"];
-    std::string token = config["token"];
-    std::string action = config["role"];
 
-    cv::CascadeClassifier plateCascade;
-    tesseract::TessBaseAPI ocr;
-    std::vector<unsigned char> buffer;
-    if (!init(plateCascade, ocr, buffer)) {
+    // 每路摄像头的读帧、检测各自一个线程, 级联分类器和 OCR 线程由各路共用, OCR 线程数默认按 CPU 核数
+    PipelineConfig pipelineConfig;
+    pipelineConfig.detectWidth = config.value("detect_width", 640);
+    pipelineConfig.display = !config.value("headless", false);
+    pipelineConfig.ocrWorkers = config.value("ocr_workers", 0);
+    pipelineConfig.cascades = config.value("cascades", 0);
+    pipelineConfig.frameSlots = config.value("frame_slots", 4);
+    pipelineConfig.ocrQueue = config.value("ocr_queue", 16);
+    pipelineConfig.dropFrames = config.value("drop_frames", true);
+    // 车牌专用的 OCR 设置: 字符白名单和车牌格式
+    pipelineConfig.ocr.language = config.value("ocr_language", pipelineConfig.ocr.language);
+    pipelineConfig.ocr.whitelist = config.value("ocr_whitelist", pipelineConfig.ocr.whitelist);
+    pipelineConfig.ocr.platePattern = config.value("plate_pattern", pipelineConfig.ocr.platePattern);
+    // 画面没有变化时跳过车牌检测
+    pipelineConfig.motionThreshold = config.value("motion_threshold", 0.005);
+    pipelineConfig.motionPixelThreshold = config.value("motion_pixel_threshold", 25);
+    pipelineConfig.motionMaxSkip = config.value("motion_max_skip", 30);
+    // 检测到车牌后只在原位置附近跟踪, 定期或跟丢时再整帧检测
+    pipelineConfig.redetectInterval = config.value("redetect_interval", 10);
+    pipelineConfig.trackMinScore = config.value("track_min_score", 0.6);
+    // 同一次通行的多帧识别结果表决后只上报一次, 同一车牌在冷却时间内不重复上报
+    pipelineConfig.passEndFrames = config.value("pass_end_frames", 5);
+    pipelineConfig.voteFrames = config.value("vote_frames", 5);
+    pipelineConfig.voteMinConfidence = config.value("vote_min_confidence", 0.5);
+    pipelineConfig.plateCooldownSeconds = config.value("plate_cooldown", 60);
+
+    std::vector<json> cameras = cameraConfigs(config);
+    if (cameras.empty()) {
+        std::cerr << "cameras 为空" << std::endl;
         return -1;
     }
-
-    std::cout << "程序启动，按q退出" << std::endl;
-    const int FRAME_SIZE = FRAME_WIDTH * FRAME_HEIGHT * 3;
-
-    bool skipDecte;
-
-    while (true)
-    {
-        if (!std::cin.read(reinterpret_cast<char*>(buffer.data()), FRAME_SIZE)) {
-            std::cerr << "读取帧失败或数据结束" << std::endl;
-            break;
+    bool multiple = config.contains("cameras");
+
+    std::vector<std::unique_ptr<FrameSource>> sources;
+    std::vector<std::string> names;
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        const json& camera = cameras[i];
+        std::string name = camera.value("name", multiple ? "camera" + std::to_string(i + 1) : std::string("camera"));
+        // 画面尺寸和像素格式需与输入一致, 对应 ffmpeg 的 -s 和 -pix_fmt
+        int width = camera.value("width", 640);
+        int height = camera.value("height", 480);
+        PixelFormat format;
+        if (!parsePixelFormat(camera.value("pixel_format", std::string("bgr24")), format)) {
+            std::cerr << name << ": 不支持的像素格式: " << camera.value("pixel_format", std::string()) << std::endl;
+            return -1;
         }
-
-        cv::Mat frame(FRAME_HEIGHT, FRAME_WIDTH, CV_8UC3, buffer.data());
-        std::vector<cv::Rect> plates;
-        cv::Mat gray;
-
-        if (!processPlatesImages(frame, plateCascade, plates, gray)) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            continue;
+        if (width <= 0 || height <= 0 || (format == PixelFormat::YUYV422 && width % 2 != 0)) {
+            std::cerr << name << ": 画面尺寸无效" << std::endl;
+            return -1;
         }
-
-        if (plates.empty()) {
-            cv::imshow("Video", frame);
-            skipDecte = false;
-            if (cv::waitKey(30) == 'q') break;
-            continue;
+        // 默认从标准输入读取 ffmpeg 输出的原始帧
+        auto source = openFrameSource(camera.value("source_type", std::string("raw")),
+                                      camera.value("source", std::string("-")), width, height, format);
+        if (!source) {
+            return -1;
         }
+        sources.push_back(std::move(source));
+        names.push_back(name);
+    }
 
-        if (skipDecte){continue;}
-
-        std::vector<std::string> plateStrings;
-        if (!getPlate(plates, plateStrings, ocr, frame, gray)) {
-            continue;
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    // 上报在后台线程进行, 服务器响应慢不会拖慢帧处理
+    // 服务器不可达时事件先写入暂存文件, 恢复后按原顺序补发; 每路各用一个暂存文件
+    std::vector<std::string> spools;
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        std::string spool = spoolPath(config, cameras[i], names[i], multiple);
+        // 共用暂存文件时各路会互相截断和重复补发
+        if (std::find(spools.begin(), spools.end(), spool) != spools.end()) {
+            std::cerr << names[i] << ": 暂存文件与其他摄像头重复: " << spool << std::endl;
+            return -1;
         }
-
-        if (!plateStrings.empty()) {
-            std::cout << "检测到车牌: " << plateStrings[0] << std::endl;
-            sendHttpPost(ip, port, token, plateStrings[0], action);
-            skipDecte = true;
+        spools.push_back(spool);
+    }
+    std::vector<std::unique_ptr<EventSender>> senders;
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        std::unique_ptr<EventSender> sender(new EventSender(ip, port, cameras[i]["token"], spools[i]));
+        if (!sender->start()) {
+            return -1;
         }
-
-        cv::imshow("Video", frame);
-        if (cv::waitKey(30) == 'q') break;
+        senders.push_back(std::move(sender));
     }
 
-    cv::destroyAllWindows();
-    ocr.End();
+    PlatePipeline pipeline(pipelineConfig);
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        pipeline.addCamera(names[i], *sources[i], *senders[i], cameras[i]["role"]);
+    }
+    if (!pipeline.start()) {
+        return -1;
+    }
+    // 无界面模式下用 Ctrl+C 或 SIGTERM 正常退出
+    activePipeline = &pipeline;
+    std::signal(SIGINT, handleSignal);
+    std::signal(SIGTERM, handleSignal);
+    pipeline.run();
+    activePipeline = nullptr;
     return 0;
-}
\ No newline at end of file
+}
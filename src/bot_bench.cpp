@@ -0,0 +1,336 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <regex>
+#include <curl/curl.h>
+#include <nlohmann/json.hpp>
+#include "httplib.h"
+#include "../include/bot_sender.hpp"
+#include "../include/plate_recognizer.hpp"
+#include "../include/frame_source.hpp"
+
+using json = nlohmann::json;
+
+// 性能测试: 回放录制的 bgr24 原始帧文件, 逐帧走与机器人相同的 processPlatesImages/getPlate,
+// 识别结果通过 EventSender 发往本进程内的桩服务器; 结束后在标准输出打印 JSON 格式的统计
+// --ocr-fixtures 模式只对一组已标注的车牌截图做 OCR, 比较调整前后两种引擎设置的耗时和准确率
+
+static const char* SPOOL_FILE = "bot_bench_spool.log";
+
+static void printUsage(const char* name)
+{
+    std::cerr << "用法: " << name << " 原始帧文件 [--size 宽x高] [--frames 最多帧数]" << std::endl;
+    std::cerr << "      " << name << " --ocr-fixtures 截图目录 [--repeat 每张识别次数]" << std::endl;
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+// 一个步骤各次耗时的分布 (毫秒)
+static json summarize(std::vector<double> samples)
+{
+    json result;
+    result["count"] = samples.size();
+    if (samples.empty()) return result;
+    std::sort(samples.begin(), samples.end());
+    double sum = 0.0;
+    for (double ms : samples) sum += ms;
+    auto percentile = [&samples](double p) {
+        return samples[std::min(samples.size() - 1, static_cast<size_t>(samples.size() * p))];
+    };
+    result["mean_ms"] = sum / samples.size();
+    result["p50_ms"] = percentile(0.50);
+    result["p90_ms"] = percentile(0.90);
+    result["p99_ms"] = percentile(0.99);
+    result["max_ms"] = samples.back();
+    return result;
+}
+
+// 调整前的引擎设置: 整块识别, 不限字符, 加载词典
+static bool initLegacyOcr(tesseract::TessBaseAPI& ocr)
+{
+    if (ocr.Init(nullptr, "eng", tesseract::OEM_LSTM_ONLY)) {
+        std::cerr << "无法初始化tesseract OCR" << std::endl;
+        return false;
+    }
+    ocr.SetPageSegMode(tesseract::PSM_SINGLE_BLOCK);
+    return true;
+}
+
+struct PlateFixture {
+    std::string file;
+    std::string expected;
+    cv::Mat gray;
+};
+
+// 读取截图目录下的 labels.txt, 每行为 "文件名 车牌"
+static bool loadFixtures(const std::string& dir, std::vector<PlateFixture>& fixtures)
+{
+    std::ifstream labels(dir + "/labels.txt");
+    if (!labels) {
+        std::cerr << "无法打开 " << dir << "/labels.txt" << std::endl;
+        return false;
+    }
+    PlateFixture fixture;
+    while (labels >> fixture.file >> fixture.expected) {
+        fixture.gray = cv::imread(dir + "/" + fixture.file, cv::IMREAD_GRAYSCALE);
+        if (fixture.gray.empty()) {
+            std::cerr << "无法读取截图 " << fixture.file << std::endl;
+            return false;
+        }
+        fixtures.push_back(fixture);
+    }
+    if (fixtures.empty()) {
+        std::cerr << "截图目录中没有标注" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// 用一种引擎设置识别全部截图, 每张 repeat 次; 结果不随次数变化, 准确率按第一次计
+static json benchOcr(tesseract::TessBaseAPI& ocr, const std::vector<PlateFixture>& fixtures, int repeat,
+                     const std::regex& platePattern)
+{
+    std::vector<double> samples;
+    json results = json::array();
+    size_t correct = 0;
+    size_t valid = 0;
+    for (const auto& fixture : fixtures) {
+        std::string text;
+        int confidence = 0;
+        for (int i = 0; i < repeat; ++i) {
+            PlateTimings timings;
+            std::string result = recognizePlate(ocr, fixture.gray, i == 0 ? &confidence : nullptr, &timings);
+            samples.push_back(timings.threshold + timings.ocr);
+            if (i == 0) text = result;
+        }
+        if (text == fixture.expected) correct++;
+        if (std::regex_match(text, platePattern)) valid++;
+        results.push_back({{"file", fixture.file}, {"expected", fixture.expected}, {"text", text},
+                           {"confidence", confidence}});
+    }
+    json report;
+    report["correct"] = correct;
+    report["accuracy"] = static_cast<double>(correct) / fixtures.size();
+    // 能通过车牌格式校验、会参加表决的结果数
+    report["valid"] = valid;
+    report["latency"] = summarize(samples);
+    report["results"] = results;
+    return report;
+}
+
+static int runOcrFixtures(const std::string& dir, int repeat)
+{
+    std::vector<PlateFixture> fixtures;
+    if (!loadFixtures(dir, fixtures)) {
+        return -1;
+    }
+    OcrOptions options;
+    std::regex platePattern(options.platePattern);
+    tesseract::TessBaseAPI legacy;
+    tesseract::TessBaseAPI tuned;
+    if (!initLegacyOcr(legacy) || !initOcr(tuned, options)) {
+        return -1;
+    }
+
+    json report;
+    report["fixtures"] = fixtures.size();
+    report["repeat"] = repeat;
+    report["legacy"] = benchOcr(legacy, fixtures, repeat, platePattern);
+    report["tuned"] = benchOcr(tuned, fixtures, repeat, platePattern);
+    std::cout << report.dump(2) << std::endl;
+    legacy.End();
+    tuned.End();
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        printUsage(argv[0]);
+        return -1;
+    }
+    if (std::string(argv[1]) == "--ocr-fixtures") {
+        if (argc < 3) {
+            printUsage(argv[0]);
+            return -1;
+        }
+        int repeat = 5;
+        for (int i = 3; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--repeat" && i + 1 < argc) {
+                repeat = std::atoi(argv[++i]);
+            } else {
+                printUsage(argv[0]);
+                return -1;
+            }
+        }
+        if (repeat <= 0) {
+            printUsage(argv[0]);
+            return -1;
+        }
+        return runOcrFixtures(argv[2], repeat);
+    }
+    std::string path = argv[1];
+    int width = 640;
+    int height = 480;
+    uint64_t maxFrames = 0;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--size" && hasValue) {
+            if (std::sscanf(argv[++i], "%dx%d", &width, &height) != 2) {
+                printUsage(argv[0]);
+                return -1;
+            }
+        } else if (arg == "--frames" && hasValue) {
+            maxFrames = std::strtoull(argv[++i], nullptr, 10);
+        } else {
+            printUsage(argv[0]);
+            return -1;
+        }
+    }
+    if (width <= 0 || height <= 0) {
+        std::cerr << "画面尺寸无效" << std::endl;
+        return -1;
+    }
+
+    auto source = openFrameSource("raw", path, width, height, PixelFormat::BGR24);
+    if (!source) {
+        return -1;
+    }
+    cv::CascadeClassifier plateCascade;
+    if (!loadPlateCascade(plateCascade)) {
+        return -1;
+    }
+    tesseract::TessBaseAPI ocr;
+    if (!initOcr(ocr)) {
+        return -1;
+    }
+
+    // 桩服务器: 总是回应成功, 不做任何处理, 因此不会用到暂存和补发
+    httplib::Server sink;
+    sink.Post("/api/opencv/process", [](const httplib::Request&, httplib::Response& res) {
+        res.set_content(R"({"success": true, "message": "ok"})", "application/json");
+    });
+    int port = sink.bind_to_any_port("127.0.0.1");
+    if (port <= 0) {
+        std::cerr << "无法启动桩服务器" << std::endl;
+        return -1;
+    }
+    std::thread sinkThread([&sink] { sink.listen_after_bind(); });
+    // 开始监听之前调用 stop 不起作用, 等它进入监听后再继续
+    while (!sink.is_running()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // 运行期间的提示信息 (如服务器响应) 改到标准错误, 标准输出只留最后的 JSON
+    std::streambuf* stdoutBuf = std::cout.rdbuf(std::cerr.rdbuf());
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    std::remove(SPOOL_FILE);
+    std::remove((std::string(SPOOL_FILE) + ".pos").c_str());
+    {
+        EventSender sender("127.0.0.1", port, "bench", SPOOL_FILE);
+        if (!sender.start()) {
+            std::cout.rdbuf(stdoutBuf);
+            sink.stop();
+            sinkThread.join();
+            return -1;
+        }
+
+        // read 为从映射区域复制出一帧 (getPlate 要在帧上画框), 其余步骤只统计实际执行了的帧
+        std::map<std::string, std::vector<double>> stages;
+        std::vector<double> frameTimes;
+        uint64_t frames = 0;
+        uint64_t detections = 0;
+        uint64_t recognized = 0;
+        uint64_t posted = 0;
+        std::atomic<bool> stop{false};
+        FrameBuffer buffer;
+        cv::Mat frame(height, width, CV_8UC3);
+        cv::Mat gray;
+
+        auto started = std::chrono::steady_clock::now();
+        while (maxFrames == 0 || frames < maxFrames) {
+            auto frameBegin = std::chrono::steady_clock::now();
+            if (!source->read(buffer, stop)) break;
+            cv::Mat(height, width, CV_8UC3, const_cast<unsigned char*>(buffer.data)).copyTo(frame);
+            auto readEnd = std::chrono::steady_clock::now();
+
+            PlateTimings timings;
+            std::vector<cv::Rect> plates;
+            std::vector<std::string> plateStrings;
+            processPlatesImages(frame, plateCascade, plates, gray, &timings);
+            getPlate(plates, plateStrings, ocr, frame, gray, &timings);
+
+            auto postBegin = std::chrono::steady_clock::now();
+            for (const auto& plate : plateStrings) {
+                if (sender.enqueue(plate, "entry")) posted++;
+            }
+            auto frameEnd = std::chrono::steady_clock::now();
+
+            frames++;
+            detections += plates.size();
+            recognized += plateStrings.size();
+            stages["read"].push_back(elapsedMs(frameBegin, readEnd));
+            stages["convert"].push_back(timings.convert);
+            stages["equalize"].push_back(timings.equalize);
+            stages["detect"].push_back(timings.detect);
+            if (!plates.empty()) {
+                stages["threshold"].push_back(timings.threshold);
+                stages["ocr"].push_back(timings.ocr);
+            }
+            if (!plateStrings.empty()) stages["post"].push_back(elapsedMs(postBegin, frameEnd));
+            frameTimes.push_back(elapsedMs(frameBegin, frameEnd));
+        }
+        double seconds = elapsedMs(started, std::chrono::steady_clock::now()) / 1000.0;
+
+        // 等发送线程把已排队的事件发完, 最多等 10 秒
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        SenderStats senderStats;
+        do {
+            senderStats = sender.stats();
+            if (senderStats.queued == 0 && senderStats.sent + senderStats.failed + senderStats.dropped >= posted) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        } while (std::chrono::steady_clock::now() < deadline);
+
+        json report;
+        report["source"] = path;
+        report["width"] = width;
+        report["height"] = height;
+        report["frames"] = frames;
+        report["seconds"] = seconds;
+        report["fps"] = seconds > 0 ? frames / seconds : 0.0;
+        report["detections"] = detections;
+        report["detections_per_second"] = seconds > 0 ? detections / seconds : 0.0;
+        report["recognized"] = recognized;
+        report["posted"] = posted;
+        report["frame"] = summarize(frameTimes);
+        for (const char* name : {"read", "convert", "equalize", "detect", "threshold", "ocr", "post"}) {
+            report["stages"][name] = summarize(stages[name]);
+        }
+        // 发送线程到桩服务器的请求往返耗时, 不计入帧处理时间
+        report["sender"] = {{"sent", senderStats.sent}, {"failed", senderStats.failed},
+                            {"dropped", senderStats.dropped}, {"p50_ms", senderStats.p50},
+                            {"p99_ms", senderStats.p99}, {"max_ms", senderStats.max}};
+
+        std::cout.rdbuf(stdoutBuf);
+        std::cout << report.dump(2) << std::endl;
+    }
+
+    sink.stop();
+    sinkThread.join();
+    ocr.End();
+    std::remove(SPOOL_FILE);
+    std::remove((std::string(SPOOL_FILE) + ".pos").c_str());
+    return 0;
+}
@@ -0,0 +1,569 @@
+#include "../include/bot_pipeline.hpp"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// 队列空或满时的等待: 先让出几次 CPU, 之后短暂休眠
+static void backoff(int& spins)
+{
+    if (spins++ < 16) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+}
+
+PlatePipeline::Camera::Camera(const PipelineConfig& config, const std::string& name, FrameSource& source,
+                              EventSender& sender, const std::string& action)
+    : name(name), source(source), sender(sender), action(action),
+      motionGate(config.motionThreshold, config.motionPixelThreshold, config.motionMaxSkip),
+      tracker(config.trackMinScore),
+      ready(config.frameSlots), freeFrames(config.frameSlots), display(2), passEnds(PASS_END_QUEUE)
+{
+    // 文件来源处理不过来时暂停读取, 每帧都处理
+    dropFrames = config.dropFrames && source.live();
+
+    detectSize = cv::Size(source.width(), source.height());
+    if (config.detectWidth > 0 && config.detectWidth < source.width()) {
+        detectSize.width = config.detectWidth;
+        detectSize.height = std::max(1, static_cast<int>(std::lround(
+            static_cast<double>(source.height()) * config.detectWidth / source.width())));
+    }
+    scaleX = static_cast<double>(source.width()) / detectSize.width;
+    scaleY = static_cast<double>(source.height()) / detectSize.height;
+}
+
+cv::Rect PlatePipeline::Camera::toFrameRect(const cv::Rect& rect) const
+{
+    cv::Rect mapped(static_cast<int>(std::lround(rect.x * scaleX)), static_cast<int>(std::lround(rect.y * scaleY)),
+                    static_cast<int>(std::lround(rect.width * scaleX)), static_cast<int>(std::lround(rect.height * scaleY)));
+    return mapped & cv::Rect(0, 0, source.width(), source.height());
+}
+
+PlatePipeline::PlatePipeline(const PipelineConfig& config) : config(config)
+{
+    this->config.frameSlots = std::max<size_t>(config.frameSlots, 1);
+    this->config.ocrQueue = std::max<size_t>(config.ocrQueue, 1);
+    this->config.voteFrames = std::max<size_t>(config.voteFrames, 1);
+}
+
+PlatePipeline::~PlatePipeline()
+{
+    stop();
+    for (auto& worker : workers) worker->ocr.End();
+}
+
+void PlatePipeline::addCamera(const std::string& name, FrameSource& source, EventSender& sender,
+                              const std::string& action)
+{
+    cameras.emplace_back(new Camera(config, name, source, sender, action));
+    cameras.back()->index = cameras.size() - 1;
+}
+
+bool PlatePipeline::start()
+{
+    if (cameras.empty()) {
+        std::cerr << "没有配置摄像头" << std::endl;
+        return false;
+    }
+    unsigned int cores = std::thread::hardware_concurrency();
+
+    size_t cascadeCount = config.cascades;
+    if (cascadeCount == 0) cascadeCount = (cameras.size() + 1) / 2;
+    if (!cascades.load(cascadeCount)) {
+        return false;
+    }
+    if (!config.ocr.platePattern.empty()) {
+        try {
+            platePattern.assign(config.ocr.platePattern);
+        } catch (const std::regex_error& e) {
+            std::cerr << "车牌格式无效: " << config.ocr.platePattern << " " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+    size_t workerCount = config.ocrWorkers;
+    if (workerCount == 0) {
+        workerCount = cores > cameras.size() + 1 ? cores - cameras.size() - 1 : 1;
+    }
+    for (size_t i = 0; i < workerCount; ++i) {
+        std::unique_ptr<Worker> worker(new Worker(config.ocrQueue * cameras.size()));
+        for (size_t c = 0; c < cameras.size(); ++c) {
+            worker->candidates.emplace_back(new SpscQueue<Candidate>(config.ocrQueue));
+        }
+        // 各线程从不同的摄像头开始轮流取
+        worker->nextCamera = i % cameras.size();
+        if (!initOcr(worker->ocr, config.ocr)) {
+            return false;
+        }
+        workers.push_back(std::move(worker));
+    }
+
+    for (auto& camera : cameras) {
+        camera->prefix = cameras.size() > 1 ? "[" + camera->name + "] " : "";
+        camera->nextWorker = camera->index % workers.size();
+        // 帧缓冲一次分配好, 之后循环使用; 映射文件的帧直接指向映射内存, 不需要缓冲
+        camera->frames.resize(config.frameSlots);
+        for (auto& frame : camera->frames) {
+            if (!camera->source.zeroCopy()) frame.storage.resize(camera->source.frameSize());
+            FrameBuffer* slot = &frame;
+            camera->freeFrames.tryPush(std::move(slot));
+        }
+    }
+
+    for (auto& worker : workers) {
+        Worker* w = worker.get();
+        w->thread = std::thread([this, w] { ocrLoop(*w); });
+    }
+    for (auto& camera : cameras) {
+        Camera* c = camera.get();
+        c->detectThread = std::thread([this, c] { detectLoop(*c); });
+        c->readThread = std::thread([this, c] { readLoop(*c); });
+    }
+
+    std::cout << "流水线启动: 摄像头 " << cameras.size() << ", 级联分类器 " << cascades.size()
+              << ", OCR 线程 " << workers.size() << std::endl;
+    for (auto& camera : cameras) {
+        std::cout << camera->prefix << camera->action << ": 画面 " << camera->source.width() << "x" << camera->source.height()
+                  << ", 检测 " << camera->detectSize.width << "x" << camera->detectSize.height
+                  << ", 帧缓冲 " << camera->frames.size()
+                  << (camera->dropFrames ? ", 处理不过来时丢帧" : ", 处理不过来时暂停读取") << std::endl;
+    }
+    return true;
+}
+
+void PlatePipeline::readLoop(Camera& camera)
+{
+    uint64_t seq = 0;
+    FrameBuffer* frame = nullptr;
+
+    while (!stopping.load(std::memory_order_relaxed)) {
+        if (!frame) {
+            int spins = 0;
+            while (!camera.freeFrames.tryPop(frame) && !camera.dropFrames) {
+                if (stopping.load(std::memory_order_relaxed)) break;
+                backoff(spins);
+            }
+        }
+
+        bool ok = frame ? camera.source.read(*frame, stopping) : camera.source.skip(stopping);
+        if (!ok) {
+            if (!stopping.load(std::memory_order_relaxed)) {
+                std::cerr << camera.prefix << "读取帧失败或数据结束" << std::endl;
+            }
+            break;
+        }
+        ++seq;
+        camera.counters.framesRead.fetch_add(1, std::memory_order_relaxed);
+        if (!frame) {
+            camera.counters.framesDropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        frame->seq = seq;
+        // 帧缓冲数与队列长度相同, 不会失败
+        camera.ready.tryPush(std::move(frame));
+        frame = nullptr;
+    }
+    camera.readDone.store(true, std::memory_order_release);
+}
+
+bool PlatePipeline::dispatch(Camera& camera, Candidate& candidate)
+{
+    int spins = 0;
+    while (!stopping.load(std::memory_order_relaxed)) {
+        for (size_t i = 0; i < workers.size(); ++i) {
+            size_t index = (camera.nextWorker + i) % workers.size();
+            if (workers[index]->candidates[camera.index]->tryPush(std::move(candidate))) {
+                camera.nextWorker = (index + 1) % workers.size();
+                return true;
+            }
+        }
+        if (spins == 0) camera.counters.stalls.fetch_add(1, std::memory_order_relaxed);
+        backoff(spins);
+    }
+    return false;
+}
+
+void PlatePipeline::detectLoop(Camera& camera)
+{
+    Counters& counters = camera.counters;
+    const int width = camera.source.width();
+    const PixelFormat format = camera.source.format();
+    bool inPass = false;
+    uint64_t pass = 0;
+    // 当前通行交给 OCR 的车牌区域数, 以及连续检测不到车牌的次数
+    uint64_t passCandidates = 0;
+    int emptyFrames = 0;
+    int spins = 0;
+    // 最近一次检测或跟踪到的车牌区域 (检测画面坐标), 以及距上次整帧检测的帧数
+    std::vector<cv::Rect> plates;
+    int sinceDetect = 0;
+    // gray 为原分辨率灰度图, 用来截取车牌区域; small 为缩小后的检测画面
+    cv::Mat gray, small, detectGray;
+
+    while (true) {
+        bool finished = camera.readDone.load(std::memory_order_acquire);
+        FrameBuffer* frame = nullptr;
+        if (!camera.ready.tryPop(frame)) {
+            if (finished || stopping.load(std::memory_order_relaxed)) break;
+            backoff(spins);
+            continue;
+        }
+        spins = 0;
+
+        // 只读: 映射文件的帧直接指向只读内存
+        cv::Mat image(camera.source.height(), width, frameMatType(format), const_cast<unsigned char*>(frame->data));
+        frameToGray(image, format, gray);
+        if (camera.detectSize.width != width) {
+            cv::resize(gray, small, camera.detectSize, 0, 0, cv::INTER_AREA);
+        } else {
+            small = gray;
+        }
+
+        if (!camera.motionGate.changed(small)) {
+            // 画面没有变化: 沿用上次的检测结果, 同样的画面也不必再识别一次
+            counters.framesStatic.fetch_add(1, std::memory_order_relaxed);
+            // 车辆离开后画面往往不再变化, 这些帧同样算作检测不到车牌, 否则通行要等强制检测才能结束
+            if (plates.empty() && inPass && ++emptyFrames >= config.passEndFrames) {
+                inPass = false;
+                endPass(camera, pass, passCandidates);
+            }
+        } else {
+            cv::equalizeHist(small, detectGray);
+            // 车牌还在画面里时先在原位置附近跟踪, 到了重新检测的间隔或跟丢了再整帧检测
+            bool tracked = false;
+            if (!camera.tracker.empty() && sinceDetect < config.redetectInterval) {
+                tracked = camera.tracker.update(detectGray, plates);
+                if (!tracked) counters.trackLost.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (tracked) {
+                ++sinceDetect;
+                counters.framesTracked.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                plates.clear();
+                cascades.detect(detectGray, plates);
+                sinceDetect = 0;
+                counters.framesDetected.fetch_add(1, std::memory_order_relaxed);
+                if (config.redetectInterval > 0) camera.tracker.reset(detectGray, plates);
+            }
+
+            if (plates.empty()) {
+                if (inPass && ++emptyFrames >= config.passEndFrames) {
+                    inPass = false;
+                    endPass(camera, pass, passCandidates);
+                }
+            } else {
+                emptyFrames = 0;
+                if (!inPass) {
+                    inPass = true;
+                    ++pass;
+                    passCandidates = 0;
+                }
+                // 这辆车已经表决过就不再识别, 等车牌离开画面后开始下一次通行
+                if (camera.postedPass.load(std::memory_order_acquire) != pass) {
+                    for (const auto& rect : plates) {
+                        cv::Rect roi = camera.toFrameRect(rect);
+                        if (roi.empty()) continue;
+                        Candidate candidate;
+                        candidate.camera = camera.index;
+                        candidate.seq = frame->seq;
+                        candidate.pass = pass;
+                        candidate.roi = gray(roi).clone();
+                        if (!dispatch(camera, candidate)) break;
+                        counters.candidates.fetch_add(1, std::memory_order_relaxed);
+                        ++passCandidates;
+                    }
+                }
+            }
+        }
+        // 显示用的画面要复制出来, 帧缓冲马上交还给读帧线程
+        if (config.display) {
+            cv::Mat shown;
+            frameToBgr(image, format, shown);
+            if (format == PixelFormat::BGR24) shown = shown.clone();
+            for (const auto& rect : plates) {
+                cv::rectangle(shown, camera.toFrameRect(rect), cv::Scalar(0, 255, 0), 2);
+            }
+            camera.display.tryPush(std::move(shown));
+        }
+        camera.freeFrames.tryPush(std::move(frame));
+    }
+    // 输入结束时画面里的车辆也算离开
+    if (inPass) endPass(camera, pass, passCandidates);
+    camera.detectDone.store(true, std::memory_order_release);
+}
+
+bool PlatePipeline::endPass(Camera& camera, uint64_t pass, uint64_t count)
+{
+    PassEnd end;
+    end.pass = pass;
+    end.candidates = count;
+    int spins = 0;
+    while (!camera.passEnds.tryPush(std::move(end))) {
+        if (stopping.load(std::memory_order_relaxed)) return false;
+        backoff(spins);
+    }
+    return true;
+}
+
+void PlatePipeline::ocrLoop(Worker& worker)
+{
+    const size_t cameraCount = cameras.size();
+    int spins = 0;
+    while (!stopping.load(std::memory_order_relaxed)) {
+        bool finished = true;
+        for (const auto& camera : cameras) {
+            if (!camera->detectDone.load(std::memory_order_acquire)) finished = false;
+        }
+
+        // 从上次之后的下一路摄像头开始找, 每次只取一个, 各路轮流
+        Candidate candidate;
+        bool found = false;
+        for (size_t i = 0; i < cameraCount && !found; ++i) {
+            size_t index = (worker.nextCamera + i) % cameraCount;
+            if (worker.candidates[index]->tryPop(candidate)) {
+                worker.nextCamera = (index + 1) % cameraCount;
+                found = true;
+            }
+        }
+        if (!found) {
+            if (finished) break;
+            backoff(spins);
+            continue;
+        }
+        spins = 0;
+
+        Camera& camera = *cameras[candidate.camera];
+        Result result;
+        result.camera = candidate.camera;
+        result.seq = candidate.seq;
+        result.pass = candidate.pass;
+        // 排队期间同一辆车已经表决完, 只回一个空结果用于计数
+        if (candidate.pass == camera.postedPass.load(std::memory_order_acquire)) {
+            camera.counters.skipped.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            result.plate = recognizePlate(worker.ocr, candidate.roi, &result.confidence);
+            camera.counters.recognized.fetch_add(1, std::memory_order_relaxed);
+            if (!result.plate.empty() && !config.ocr.platePattern.empty() &&
+                !std::regex_match(result.plate, platePattern)) {
+                camera.counters.invalid.fetch_add(1, std::memory_order_relaxed);
+                result.plate.clear();
+            }
+        }
+
+        while (!worker.results.tryPush(std::move(result))) {
+            if (stopping.load(std::memory_order_relaxed)) break;
+            backoff(spins);
+        }
+    }
+    worker.done.store(true, std::memory_order_release);
+}
+
+void PlatePipeline::handleResult(const Result& result)
+{
+    Camera& camera = *cameras[result.camera];
+    auto it = camera.passes.emplace(result.pass, PassState()).first;
+    PassState& state = it->second;
+    state.received++;
+    if (!result.plate.empty() && !state.decided) {
+        state.vote.add(result.plate, result.confidence);
+        if (state.vote.size() >= config.voteFrames) decidePass(camera, result.pass, state, false);
+    }
+    if (state.ended && state.received >= state.expected) closePass(camera, it);
+}
+
+void PlatePipeline::handlePassEnd(Camera& camera, const PassEnd& end)
+{
+    auto it = camera.passes.emplace(end.pass, PassState()).first;
+    it->second.ended = true;
+    it->second.expected = end.candidates;
+    if (it->second.received >= it->second.expected) closePass(camera, it);
+}
+
+void PlatePipeline::closePass(Camera& camera, std::map<uint64_t, PassState>::iterator it)
+{
+    if (!it->second.decided) decidePass(camera, it->first, it->second, true);
+    camera.passes.erase(it);
+}
+
+bool PlatePipeline::decidePass(Camera& camera, uint64_t pass, PassState& state, bool final)
+{
+    double confidence = 0.0;
+    std::string plate = state.vote.result(confidence);
+    // 车辆还在画面里时置信度不够就继续攒结果, 攒得太多也不再等
+    if (!final && confidence < config.voteMinConfidence && state.vote.size() < config.voteFrames * 4) {
+        return false;
+    }
+
+    state.decided = true;
+    // 较早通行的结果晚到时不影响当前车辆的跳过判断
+    if (pass > camera.postedPass.load(std::memory_order_relaxed)) {
+        camera.postedPass.store(pass, std::memory_order_release);
+    }
+    if (state.vote.empty()) return true;
+
+    if (confidence < config.voteMinConfidence) {
+        std::cerr << camera.prefix << "车牌识别置信度过低, 不上报: " << plate << " (置信度 " << confidence
+                  << ", " << state.vote.size() << " 帧)" << std::endl;
+        camera.counters.rejected.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    auto cooldown = std::chrono::seconds(config.plateCooldownSeconds);
+    for (auto p = camera.lastPosted.begin(); p != camera.lastPosted.end();) {
+        if (now - p->second >= cooldown) {
+            p = camera.lastPosted.erase(p);
+        } else {
+            ++p;
+        }
+    }
+    if (camera.lastPosted.count(plate)) {
+        std::cout << camera.prefix << "车牌在冷却时间内, 不重复上报: " << plate << std::endl;
+        camera.counters.suppressed.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    camera.lastPosted[plate] = now;
+
+    std::cout << camera.prefix << "检测到车牌: " << plate << " (置信度 " << confidence << ", "
+              << state.vote.size() << " 帧)" << std::endl;
+    camera.sender.enqueue(plate, camera.action);
+    camera.counters.events.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool PlatePipeline::drainQueues()
+{
+    bool handled = false;
+    for (auto& worker : workers) {
+        Result result;
+        while (worker->results.tryPop(result)) {
+            handleResult(result);
+            handled = true;
+        }
+    }
+    for (auto& camera : cameras) {
+        PassEnd end;
+        while (camera->passEnds.tryPop(end)) {
+            handlePassEnd(*camera, end);
+            handled = true;
+        }
+    }
+    return handled;
+}
+
+void PlatePipeline::run()
+{
+    std::cout << (config.display ? "程序启动，按q退出" : "程序启动，按Ctrl+C退出") << std::endl;
+    auto lastStats = std::chrono::steady_clock::now();
+    int spins = 0;
+
+    while (true) {
+        bool finished = true;
+        for (auto& worker : workers) {
+            if (!worker->done.load(std::memory_order_acquire)) finished = false;
+        }
+        // 先读完成标志再取结果, 线程结束前放进队列的结果都能取到
+        bool idle = !drainQueues();
+
+        if (config.display) {
+            for (auto& camera : cameras) {
+                cv::Mat latest, shown;
+                while (camera->display.tryPop(shown)) latest = shown;
+                if (!latest.empty()) cv::imshow(cameras.size() > 1 ? "Video " + camera->name : "Video", latest);
+            }
+            if (cv::waitKey(1) == 'q') stopping.store(true);
+        } else if (idle) {
+            backoff(spins);
+        } else {
+            spins = 0;
+        }
+
+        if (finished || stopping.load()) break;
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastStats >= std::chrono::seconds(STATS_INTERVAL_SECONDS)) {
+            lastStats = now;
+            printStats();
+        }
+    }
+
+    stop();
+    // 线程都已退出: 取走停止期间放进队列的结果和通行结束通知, 还没表决的通行 (包括画面中的车辆) 用已有结果表决
+    drainQueues();
+    for (auto& camera : cameras) {
+        while (!camera->passes.empty()) closePass(*camera, camera->passes.begin());
+    }
+    if (config.display) cv::destroyAllWindows();
+    printStats();
+}
+
+void PlatePipeline::stop()
+{
+    stopping.store(true);
+    for (auto& camera : cameras) {
+        if (camera->readThread.joinable()) camera->readThread.join();
+        if (camera->detectThread.joinable()) camera->detectThread.join();
+    }
+    for (auto& worker : workers) {
+        if (worker->thread.joinable()) worker->thread.join();
+    }
+}
+
+PipelineStats PlatePipeline::snapshot(const Counters& counters)
+{
+    PipelineStats s;
+    s.framesRead = counters.framesRead.load();
+    s.framesDropped = counters.framesDropped.load();
+    s.framesDetected = counters.framesDetected.load();
+    s.framesStatic = counters.framesStatic.load();
+    s.framesTracked = counters.framesTracked.load();
+    s.trackLost = counters.trackLost.load();
+    s.candidates = counters.candidates.load();
+    s.skipped = counters.skipped.load();
+    s.recognized = counters.recognized.load();
+    s.invalid = counters.invalid.load();
+    s.events = counters.events.load();
+    s.rejected = counters.rejected.load();
+    s.suppressed = counters.suppressed.load();
+    s.stalls = counters.stalls.load();
+    return s;
+}
+
+PipelineStats PlatePipeline::stats() const
+{
+    PipelineStats total;
+    for (const auto& camera : cameras) {
+        PipelineStats s = snapshot(camera->counters);
+        total.framesRead += s.framesRead;
+        total.framesDropped += s.framesDropped;
+        total.framesDetected += s.framesDetected;
+        total.framesStatic += s.framesStatic;
+        total.framesTracked += s.framesTracked;
+        total.trackLost += s.trackLost;
+        total.candidates += s.candidates;
+        total.skipped += s.skipped;
+        total.recognized += s.recognized;
+        total.invalid += s.invalid;
+        total.events += s.events;
+        total.rejected += s.rejected;
+        total.suppressed += s.suppressed;
+        total.stalls += s.stalls;
+    }
+    return total;
+}
+
+void PlatePipeline::printStats()
+{
+    for (const auto& camera : cameras) {
+        PipelineStats s = snapshot(camera->counters);
+        std::cout << camera->prefix << "流水线统计: 读帧 " << s.framesRead << ", 丢帧 " << s.framesDropped
+                  << ", 检测 " << s.framesDetected << ", 无变化跳过 " << s.framesStatic
+                  << ", 跟踪 " << s.framesTracked << ", 跟丢 " << s.trackLost
+                  << ", 车牌区域 " << s.candidates
+                  << ", 识别 " << s.recognized << ", 格式不符 " << s.invalid << ", 跳过 " << s.skipped
+                  << ", 上报 " << s.events << ", 置信度低 " << s.rejected << ", 冷却 " << s.suppressed
+                  << ", OCR 排满 " << s.stalls << std::endl;
+    }
+}
@@ -0,0 +1,442 @@
+#include "../include/bot_sender.hpp"
+#include <nlohmann/json.hpp>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <random>
+#include <ctime>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+// cURL 回调函数
+static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp)
+{
+    std::string* str = (std::string*)userp;
+    size_t totalSize = size * nmemb;
+    str->append((char*)contents, totalSize);
+    return totalSize;
+}
+
+// 服务器接受的本地时间格式 YYYY-MM-DDTHH:MM:SS
+static std::string formatLocalTime(int64_t t)
+{
+    time_t tt = static_cast<time_t>(t);
+    struct tm tmv;
+    localtime_r(&tt, &tmv);
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tmv);
+    return buf;
+}
+
+static json eventToJson(const PlateEvent& event)
+{
+    return {
+        {"license_plate", event.plate},
+        {"action", event.action},
+        {"timestamp", formatLocalTime(event.captureTime)},
+        {"event_id", event.eventId}
+    };
+}
+
+// 服务器自身出错 (如落盘失败) 的结果, 稍后重试可能成功; 无法解析的结果也按此处理
+// 其余 fail/error 是服务器对事件本身的明确拒绝 (如车辆已在场、格式错误), 重试也不会成功
+static bool transientResult(const json& result)
+{
+    if (!result.is_object() || !result.contains("result")) return true;
+    std::string message = result.value("message", "");
+    return result.value("result", "") == "fail" && (message == "数据库错误" || message == "配置文件错误");
+}
+
+EventSender::EventSender(const std::string& ip, int port, const std::string& token,
+                         const std::string& spoolPath, size_t capacity)
+    : baseUrl("http://" + ip + ":" + std::to_string(port)), token(token), capacity(capacity), spoolPath(spoolPath)
+{
+}
+
+EventSender::~EventSender()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_one();
+    if (thread.joinable()) thread.join();
+    if (curl) printStats();
+    if (spoolFd >= 0) ::close(spoolFd);
+    if (headers) curl_slist_free_all(headers);
+    if (curl) curl_easy_cleanup(curl);
+}
+
+bool EventSender::start()
+{
+    curl = curl_easy_init();
+    if (!curl) {
+        std::cerr << "无法初始化curl" << std::endl;
+        return false;
+    }
+    headers = curl_slist_append(headers, "Content-Type: application/json");
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    // 同一个句柄复用 TCP 连接, 连接断开后 curl 会自动重连
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, 2000L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, 5000L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+    if (!openSpool()) return false;
+
+    std::random_device rd;
+    eventSeq = (static_cast<uint64_t>(rd()) << 32) ^ rd();
+    latencies.reserve(LATENCY_SAMPLES);
+    thread = std::thread(&EventSender::run, this);
+    return true;
+}
+
+// 打开暂存文件; 上次退出时还有未补发的事件就直接进入补发状态
+bool EventSender::openSpool()
+{
+    spoolFd = ::open(spoolPath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (spoolFd < 0) {
+        std::cerr << "无法打开暂存文件 " << spoolPath << std::endl;
+        return false;
+    }
+    std::ifstream pos(spoolPath + ".pos");
+    if (!(pos >> spoolPos)) spoolPos = 0;
+    // 截掉崩溃时写了一半的最后一行, 否则之后追加的记录会和它连在一起
+    off_t size = ::lseek(spoolFd, 0, SEEK_END);
+    {
+        std::ifstream in(spoolPath, std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        size_t valid = content.rfind('\n');
+        valid = valid == std::string::npos ? 0 : valid + 1;
+        if (valid != content.size()) {
+            if (::ftruncate(spoolFd, static_cast<off_t>(valid)) != 0) return false;
+            size = static_cast<off_t>(valid);
+        }
+    }
+    if (size > 0 && static_cast<uint64_t>(size) > spoolPos) {
+        spooling = true;
+        nextReplay = std::chrono::steady_clock::now();
+        std::cout << "暂存文件中有未上报的事件, 将按顺序补发" << std::endl;
+    } else if (size > 0) {
+        if (::ftruncate(spoolFd, 0) != 0) return false;
+        spoolPos = 0;
+        saveSpoolPos();
+    }
+    return true;
+}
+
+// 追加并落盘, 崩溃时最多丢掉写了一半的最后一行
+bool EventSender::appendSpool(const PlateEvent& event)
+{
+    std::string line = eventToJson(event).dump() + "\n";
+    const char* p = line.data();
+    size_t left = line.size();
+    while (left > 0) {
+        ssize_t n = ::write(spoolFd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "写入暂存文件失败, 丢弃车牌: " << event.plate << std::endl;
+            return false;
+        }
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+    ::fdatasync(spoolFd);
+    std::lock_guard<std::mutex> statsLock(statsMutex);
+    counters.spooled++;
+    return true;
+}
+
+// 进度文件不需要落盘: 崩溃后重复补发的事件会被服务器按 event_id 去重
+void EventSender::saveSpoolPos()
+{
+    std::string tmp = spoolPath + ".pos.tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        out << spoolPos;
+    }
+    std::rename(tmp.c_str(), (spoolPath + ".pos").c_str());
+}
+
+bool EventSender::enqueue(const std::string& plate, const std::string& action)
+{
+    PlateEvent event;
+    event.plate = plate;
+    event.action = action;
+    event.captureTime = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.size() >= capacity) {
+            std::lock_guard<std::mutex> statsLock(statsMutex);
+            counters.dropped++;
+            std::cerr << "发送队列已满, 丢弃车牌: " << plate << std::endl;
+            return false;
+        }
+        event.eventId = std::to_string(event.captureTime) + "-" + std::to_string(eventSeq++);
+        queue.push_back(std::move(event));
+    }
+    cv.notify_one();
+    return true;
+}
+
+bool EventSender::request(const std::string& path, const std::string& body, std::string& response, bool& retryable)
+{
+    std::string url = baseUrl + path;
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(body.size()));
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+
+    auto begin = std::chrono::steady_clock::now();
+    CURLcode res = curl_easy_perform(curl);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    if (res != CURLE_OK) {
+        std::cerr << "请求失败: " << curl_easy_strerror(res) << std::endl;
+        retryable = true;
+        return false;
+    }
+
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    // 服务器错误、认证失败 (配置修正后可以成功) 和限流都稍后重试
+    if (status >= 500 || status == 401 || status == 403 || status == 408 || status == 429) {
+        std::cerr << "请求失败: HTTP " << status << std::endl;
+        retryable = true;
+        return false;
+    }
+    recordLatency(ms);
+    if (status != 200) {
+        // 其余 4xx 重试也不会成功
+        std::cerr << "请求被拒绝: HTTP " << status << " " << response << std::endl;
+        retryable = false;
+        return false;
+    }
+    return true;
+}
+
+bool EventSender::post(const PlateEvent& event, bool& retryable)
+{
+    json payload = eventToJson(event);
+    payload["token"] = token;
+    std::string response;
+    if (!request("/api/opencv/process", payload.dump(), response, retryable)) return false;
+    json result = json::parse(response, nullptr, false);
+    if (transientResult(result)) {
+        std::cerr << "服务器处理失败: " << event.plate << " " << response << std::endl;
+        retryable = true;
+        return false;
+    }
+    std::cout << "服务器响应: " << event.plate << " " << result.value("message", "") << std::endl;
+    return true;
+}
+
+// 通过批量接口补发, 返回按顺序处理完 (送达或被服务器明确拒绝) 的事件数, 停在第一条需要重试的事件
+size_t EventSender::replayBatch(const json& events)
+{
+    json payload = {{"token", token}, {"events", events}};
+    std::string response;
+    bool retryable = false;
+    if (!request("/api/opencv/batch", payload.dump(), response, retryable)) {
+        if (retryable) return 0;
+        // 整批被拒绝 (如其中一条导致请求无法解析): 改为逐条发送, 只丢弃被单独拒绝的事件
+        std::cerr << "批量补发被拒绝, 改为逐条补发" << std::endl;
+        return replayEach(events);
+    }
+    json body = json::parse(response, nullptr, false);
+    json results = body.is_object() ? body.value("results", json::array()) : json::array();
+    for (size_t i = 0; i < events.size(); i++) {
+        json result = i < results.size() ? results[i] : json();
+        if (transientResult(result)) {
+            std::cerr << "补发失败, 稍后重试: " << events[i].value("license_plate", "") << " " << result.dump() << std::endl;
+            return i;
+        }
+        std::cout << "补发: " << events[i].value("license_plate", "") << " "
+                  << result.value("message", result.value("error", "")) << std::endl;
+        std::lock_guard<std::mutex> statsLock(statsMutex);
+        // 格式错误被拒绝的计为失败, 业务失败 (如车辆已在场) 与直接上报一样计为已送达
+        if (result.value("result", "") == "error") {
+            counters.failed++;
+        } else {
+            counters.sent++;
+        }
+    }
+    return events.size();
+}
+
+// 逐条补发, 返回值同 replayBatch
+size_t EventSender::replayEach(const json& events)
+{
+    for (size_t i = 0; i < events.size(); i++) {
+        json payload = events[i];
+        payload["token"] = token;
+        std::string response;
+        bool retryable = false;
+        if (!request("/api/opencv/process", payload.dump(), response, retryable)) {
+            if (retryable) return i;
+            std::lock_guard<std::mutex> statsLock(statsMutex);
+            counters.failed++;
+            continue;
+        }
+        json result = json::parse(response, nullptr, false);
+        if (transientResult(result)) {
+            std::cerr << "补发失败, 稍后重试: " << events[i].value("license_plate", "") << " " << response << std::endl;
+            return i;
+        }
+        std::cout << "补发: " << events[i].value("license_plate", "") << " " << result.value("message", "") << std::endl;
+        std::lock_guard<std::mutex> statsLock(statsMutex);
+        counters.sent++;
+    }
+    return events.size();
+}
+
+// 从上次的位置读出一批事件, 通过批量接口按原顺序补发
+EventSender::Replay EventSender::replaySpool()
+{
+    std::ifstream in(spoolPath);
+    in.seekg(static_cast<std::streamoff>(spoolPos));
+    json events = json::array();
+    // 各事件在暂存文件中的起始位置, 需要重试时从该事件重新开始
+    std::vector<uint64_t> starts;
+    uint64_t pos = spoolPos;
+    std::string line;
+    while (events.size() < REPLAY_BATCH && std::getline(in, line)) {
+        if (in.eof()) break;
+        uint64_t start = pos;
+        pos += line.size() + 1;
+        json item = json::parse(line, nullptr, false);
+        if (item.is_discarded() || !item.is_object()) continue;
+        starts.push_back(start);
+        events.push_back(std::move(item));
+    }
+
+    if (!events.empty()) {
+        size_t done = replayBatch(events);
+        if (done < events.size()) {
+            // 已处理的部分不再补发; 之后的事件即使已被服务器处理, 重发时也会按 event_id 去重
+            if (done > 0) {
+                spoolPos = starts[done];
+                saveSpoolPos();
+            }
+            return Replay::Failed;
+        }
+    }
+    spoolPos = pos;
+    if (in.good() || ::ftruncate(spoolFd, 0) != 0) {
+        saveSpoolPos();
+        return Replay::Progress;
+    }
+
+    // 全部补发完: 清空暂存文件, 回到直接上报
+    spoolPos = 0;
+    saveSpoolPos();
+    std::cout << "暂存事件已全部补发" << std::endl;
+    return Replay::Drained;
+}
+
+void EventSender::run()
+{
+    while (true) {
+        std::deque<PlateEvent> batch;
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (spooling) {
+                cv.wait_until(lock, nextReplay, [this] { return stopping || !queue.empty(); });
+            } else {
+                cv.wait(lock, [this] { return stopping || !queue.empty(); });
+            }
+            batch.swap(queue);
+            stop = stopping;
+        }
+
+        for (auto& event : batch) {
+            // 补发期间的新事件排在暂存事件之后, 保持顺序
+            if (spooling) {
+                appendSpool(event);
+                continue;
+            }
+            bool retryable = false;
+            if (post(event, retryable)) {
+                uint64_t sent;
+                {
+                    std::lock_guard<std::mutex> statsLock(statsMutex);
+                    sent = ++counters.sent;
+                }
+                if (sent % STATS_INTERVAL == 0) printStats();
+            } else if (retryable && appendSpool(event)) {
+                std::cerr << "服务器不可达, 事件已暂存: " << event.plate << std::endl;
+                spooling = true;
+                backoffMs = BACKOFF_BASE_MS;
+                nextReplay = std::chrono::steady_clock::now() + std::chrono::milliseconds(backoffMs);
+            } else {
+                std::lock_guard<std::mutex> statsLock(statsMutex);
+                counters.failed++;
+            }
+        }
+        if (stop) return;
+
+        // 按指数退避补发暂存事件; 成功一批后立即继续下一批
+        if (spooling && std::chrono::steady_clock::now() >= nextReplay) {
+            Replay result = replaySpool();
+            if (result == Replay::Failed) {
+                {
+                    std::lock_guard<std::mutex> statsLock(statsMutex);
+                    counters.retries++;
+                }
+                nextReplay = std::chrono::steady_clock::now() + std::chrono::milliseconds(backoffMs);
+                backoffMs = std::min(backoffMs * 2, BACKOFF_MAX_MS);
+            } else {
+                spooling = result != Replay::Drained;
+                backoffMs = BACKOFF_BASE_MS;
+                nextReplay = std::chrono::steady_clock::now();
+            }
+        }
+    }
+}
+
+void EventSender::recordLatency(double ms)
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    if (latencies.size() < LATENCY_SAMPLES) {
+        latencies.push_back(ms);
+    } else {
+        latencies[latencyPos] = ms;
+        latencyPos = (latencyPos + 1) % LATENCY_SAMPLES;
+    }
+}
+
+SenderStats EventSender::stats()
+{
+    SenderStats result;
+    std::vector<double> samples;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        result = counters;
+        samples = latencies;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        result.queued = queue.size();
+    }
+    if (!samples.empty()) {
+        std::sort(samples.begin(), samples.end());
+        result.p50 = samples[samples.size() / 2];
+        result.p99 = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+        result.max = samples.back();
+    }
+    return result;
+}
+
+void EventSender::printStats()
+{
+    SenderStats s = stats();
+    std::cout << "上报统计: 成功 " << s.sent << ", 失败 " << s.failed << ", 重试 " << s.retries
+              << ", 丢弃 " << s.dropped << ", 暂存 " << s.spooled << ", 排队 " << s.queued
+              << ", 延迟 p50 " << s.p50 << "ms p99 " << s.p99 << "ms max " << s.max << "ms" << std::endl;
+}
@@ -0,0 +1,38 @@
+#include "../include/cascade_pool.hpp"
+
+bool CascadePool::load(size_t count)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < count; ++i) {
+        std::unique_ptr<cv::CascadeClassifier> classifier(new cv::CascadeClassifier());
+        if (!loadPlateCascade(*classifier)) {
+            return false;
+        }
+        idle.push_back(classifier.get());
+        classifiers.push_back(std::move(classifier));
+    }
+    return !classifiers.empty();
+}
+
+void CascadePool::detect(const cv::Mat& gray, std::vector<cv::Rect>& plates)
+{
+    cv::CascadeClassifier* classifier = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        uint64_t ticket = nextTicket++;
+        available.wait(lock, [&] { return ticket == serving && !idle.empty(); });
+        serving++;
+        classifier = idle.back();
+        idle.pop_back();
+    }
+    // 下一个排队的线程可能也有空闲的分类器可用
+    available.notify_all();
+
+    detectPlates(*classifier, gray, plates);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.push_back(classifier);
+    }
+    available.notify_all();
+}
@@ -0,0 +1,92 @@
+#include "../include/config.hpp"
+#include <nlohmann/json.hpp>
+#include <fstream>
+#include <iostream>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+Config& Config::getInstance() {
+    static Config instance;
+    return instance;
+}
+
+Config::~Config() {
+    stopWatching = true;
+    if (watchThread.joinable()) watchThread.join();
+    if (inotifyFd >= 0) ::close(inotifyFd);
+}
+
+bool Config::loadFeeConfig() {
+    std::ifstream config_file("config.json");
+    if (!config_file.is_open()) {
+        std::cerr << "Error: Could not open config.json." << std::endl;
+        return false;
+    }
+    auto fee = std::make_shared<FeeConfig>();
+    try {
+        json config = json::parse(config_file);
+        fee->freeTime = config.at("freetime");
+        fee->stageTime = config.at("fee_stage_time");
+        fee->stagePrice = config.at("fee_stage_price");
+        fee->dayTop = config.at("fee_day_top");
+    } catch (const json::exception& e) {
+        std::cerr << "Error: Invalid fee config in config.json: " << e.what() << std::endl;
+        return false;
+    }
+    if (fee->stageTime <= 0) {
+        std::cerr << "Error: fee_stage_time must be positive." << std::endl;
+        return false;
+    }
+    // 读者持有旧对象的引用计数, 替换不会影响正在进行的计费
+    std::atomic_store(&feeConfig, std::shared_ptr<const FeeConfig>(fee));
+    return true;
+}
+
+std::shared_ptr<const FeeConfig> Config::getFeeConfig() const {
+    return std::atomic_load(&feeConfig);
+}
+
+void Config::onFileChange(const std::string& filename, std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(callbacksMutex);
+    callbacks[filename] = std::move(callback);
+}
+
+// 监听整个目录而不是单个文件, 这样编辑器"写临时文件再改名"的保存方式也能收到通知
+bool Config::startWatching() {
+    inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        std::cerr << "Error: inotify_init1 failed, config hot reload disabled." << std::endl;
+        return false;
+    }
+    if (::inotify_add_watch(inotifyFd, ".", IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        std::cerr << "Error: inotify_add_watch failed, config hot reload disabled." << std::endl;
+        return false;
+    }
+    watchThread = std::thread(&Config::watchLoop, this);
+    return true;
+}
+
+void Config::watchLoop() {
+    alignas(inotify_event) char buf[4096];
+    while (!stopWatching) {
+        pollfd pfd = {inotifyFd, POLLIN, 0};
+        if (::poll(&pfd, 1, 1000) <= 0) continue;
+        ssize_t len = ::read(inotifyFd, buf, sizeof(buf));
+        if (len <= 0) continue;
+        for (char* p = buf; p < buf + len; ) {
+            auto* event = reinterpret_cast<inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+            if (event->len == 0) continue;
+            std::function<void()> callback;
+            {
+                std::lock_guard<std::mutex> lock(callbacksMutex);
+                auto it = callbacks.find(event->name);
+                if (it != callbacks.end()) callback = it->second;
+            }
+            if (callback) callback();
+        }
+    }
+}
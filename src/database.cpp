@@ -1,11 +1,62 @@
 #include "../include/database.hpp"
+#include "../include/utils.hpp"
 #include <filesystem>
+#include <algorithm>
+#include <tuple>
+#include <cerrno>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char* VEHICLES_FILE = "vehicles.json";
+// 预写日志文件, 每行一条 {"plate", "flags", "entry_time", "monthly_expiry", ["event", "time", "fee", "index"]} 记录
+static const char* VEHICLES_WAL = "vehicles.wal";
+// 写快照期间轮换出去的日志, 快照落盘后删除
+static const char* VEHICLES_WAL_OLD = "vehicles.wal.old";
+// 快照持有车牌锁时把当前日志改名为它, 释放锁后再并入 VEHICLES_WAL_OLD
+static const char* VEHICLES_WAL_ROTATED = "vehicles.wal.rotated";
+// 日志累计多少条记录后由后台线程写一次快照并轮换日志
+static const size_t SNAPSHOT_INTERVAL = 1000;
+// 幂等表快照, 与 vehicles.json 一起写出; 格式为按写入先后排列的 [key, response] 数组
+static const char* IDEMPOTENCY_FILE = "idempotency.json";
+// 幂等表最多保留的键数
+static const size_t IDEMPOTENCY_CAPACITY = 65536;
+
+// 写满 len 字节, 被信号打断时继续
+static bool writeAll(int fd, const char* p, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
 
 Database& Database::getInstance() {
     static Database instance;
     return instance;
 }
 
+Database::~Database() {
+    close();
+}
+
+void Database::close() {
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        snapshotStop = true;
+        snapshotCv.notify_one();
+    }
+    if (snapshotThread.joinable()) snapshotThread.join();
+    std::lock_guard<std::mutex> lock(walMutex);
+    if (walFd >= 0) ::close(walFd);
+    walFd = -1;
+}
+
 json Database::readJson(const std::string& filename) {
     std::ifstream file(filename);
     if (file.good()) {
@@ -33,16 +84,670 @@ json Database::getUsers() {
 }
 
 bool Database::saveUsers(const json& data) {
+    {
+        std::lock_guard<std::mutex> lock(usersMutex);
+        if (!writeJson("users.json", data)) return false;
+    }
+    return loadUsers();
+}
+
+bool Database::loadUsers() {
     std::lock_guard<std::mutex> lock(usersMutex);
-    return writeJson("users.json", data);
+    std::ifstream file("users.json");
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open users.json." << std::endl;
+        return false;
+    }
+    auto directory = std::make_shared<UserDirectory>();
+    try {
+        json users = json::parse(file);
+        for (const auto& user : users) {
+            std::string username = user.at("username");
+            UserInfo info;
+            info.auth = user.at("auth");
+            info.role = user.at("role");
+            // 重名或重复密钥时与原来的顺序查找一致, 以文件中第一条为准
+            if (info.role == "bot") directory->botsByToken.emplace(info.auth, username);
+            directory->byName.emplace(username, std::move(info));
+        }
+    } catch (const json::exception& e) {
+        std::cerr << "Error: Invalid users.json: " << e.what() << std::endl;
+        return false;
+    }
+    std::atomic_store(&userDirectory, std::shared_ptr<const UserDirectory>(directory));
+    return true;
+}
+
+bool Database::findUser(const std::string& username, UserInfo& out) {
+    auto directory = std::atomic_load(&userDirectory);
+    if (!directory) return false;
+    auto it = directory->byName.find(username);
+    if (it == directory->byName.end()) return false;
+    out = it->second;
+    return true;
+}
+
+bool Database::findBotByToken(const std::string& token, std::string& username) {
+    auto directory = std::atomic_load(&userDirectory);
+    if (!directory) return false;
+    auto it = directory->botsByToken.find(token);
+    if (it == directory->botsByToken.end()) return false;
+    username = it->second;
+    return true;
+}
+
+size_t Database::shardIndex(const std::string& plate) const {
+    return std::hash<std::string>{}(plate) % SHARD_COUNT;
+}
+
+std::unique_lock<std::recursive_mutex> Database::lockPlate(const std::string& plate) {
+    return std::unique_lock<std::recursive_mutex>(plateLocks[shardIndex(plate)]);
+}
+
+// 返回车牌在分片中的槽位, 新车牌追加到各列末尾; 调用方需持有分片锁
+uint32_t Database::internPlate(Shard& shard, const std::string& plate) {
+    auto it = shard.slots.find(plate);
+    if (it != shard.slots.end()) return it->second;
+    uint32_t slot = static_cast<uint32_t>(shard.plates.size());
+    // deque 追加元素不会移动已有字符串, 索引里的 string_view 始终有效
+    shard.plates.push_back(plate);
+    shard.slots.emplace(shard.plates.back(), slot);
+    shard.flags.push_back(0);
+    shard.entryTimes.push_back(0);
+    shard.monthlyExpiries.push_back(0);
+    return slot;
+}
+
+// 从各列拼出一辆车的记录; 调用方需持有分片锁
+VehicleRecord Database::loadRecord(const Shard& shard, uint32_t slot) {
+    VehicleRecord record;
+    uint8_t flags = shard.flags[slot];
+    record.inside = (flags & FLAG_INSIDE) != 0;
+    record.monthly = (flags & FLAG_MONTHLY) != 0;
+    record.blacklisted = (flags & FLAG_BLACKLISTED) != 0;
+    record.entryTime = shard.entryTimes[slot];
+    record.monthlyExpiry = shard.monthlyExpiries[slot];
+    return record;
+}
+
+// 把记录拆到各列, 不维护在场索引; 调用方需持有分片锁
+void Database::storeRecord(Shard& shard, uint32_t slot, const VehicleRecord& record) {
+    shard.flags[slot] = static_cast<uint8_t>((record.inside ? FLAG_INSIDE : 0) | (record.monthly ? FLAG_MONTHLY : 0) |
+                                             (record.blacklisted ? FLAG_BLACKLISTED : 0));
+    shard.entryTimes[slot] = record.entryTime;
+    shard.monthlyExpiries[slot] = record.monthlyExpiry;
+}
+
+// 写入新状态并维护在场索引; 调用方需持有分片锁
+void Database::applyRecord(Shard& shard, uint32_t slot, const VehicleRecord& record) {
+    bool wasInside = (shard.flags[slot] & FLAG_INSIDE) != 0;
+    storeRecord(shard, slot, record);
+    if (record.inside && !wasInside) {
+        shard.inside.insert(slot);
+        insideCount++;
+    } else if (!record.inside && wasInside) {
+        shard.inside.erase(slot);
+        insideCount--;
+    }
+}
+
+// 从快照或旧格式日志中的 JSON 车辆对象恢复记录, 兼容字符串时间
+// 旧版本把历史记录放在车辆对象里, 收集到 legacyHistory 中留待导入 HistoryLog
+void Database::loadVehicleJson(const std::string& plate, const json& v, std::map<std::string, json>* legacyHistory) {
+    auto toEpoch = [](const json& field) -> int64_t {
+        if (field.is_number()) return field.get<int64_t>();
+        int64_t t = 0;
+        if (field.is_string()) utils::parseTime(field.get<std::string>(), t);
+        return t;
+    };
+    VehicleRecord record;
+    record.inside = v.value("is_inside", false);
+    record.monthly = v.value("is_monthly", false);
+    record.blacklisted = v.value("is_blacklisted", false);
+    if (v.contains("entry_time")) record.entryTime = toEpoch(v["entry_time"]);
+    if (v.contains("monthly_expiry")) record.monthlyExpiry = toEpoch(v["monthly_expiry"]);
+
+    auto& shard = shards[shardIndex(plate)];
+    storeRecord(shard, internPlate(shard, plate), record);
+
+    if (legacyHistory && (v.contains("history_entries") || v.contains("history_exits"))) {
+        json events = json::array();
+        for (const auto& t : v.value("history_entries", json::array())) events.push_back({toEpoch(t), VehicleEvent::Entry});
+        for (const auto& t : v.value("history_exits", json::array())) events.push_back({toEpoch(t), VehicleEvent::Exit});
+        (*legacyHistory)[plate] = events;
+    }
+}
+
+// 按时间顺序把旧版本的历史记录导入 HistoryLog, 只在历史日志为空时执行一次
+void Database::importLegacyHistory(const std::map<std::string, json>& legacyHistory) {
+    auto& history = HistoryLog::getInstance();
+    for (const auto& [plate, events] : legacyHistory) {
+        std::vector<std::tuple<int64_t, VehicleEvent, double>> sorted;
+        for (const auto& e : events) {
+            sorted.emplace_back(e[0].get<int64_t>(), e[1].get<VehicleEvent>(), e.size() > 2 ? e[2].get<double>() : 0.0);
+        }
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [](const auto& a, const auto& b) { return std::get<0>(a) < std::get<0>(b); });
+        for (const auto& [time, type, fee] : sorted) {
+            if (!history.append(plate, type, time, fee)) {
+                std::cerr << "Error: Could not import history of " << plate << std::endl;
+                return;
+            }
+        }
+    }
+}
+
+// 重放一个日志文件, 返回成功应用的记录数
+size_t Database::replayWal(const std::string& filename, std::map<std::string, json>* legacyHistory) {
+    size_t replayed = 0;
+    std::ifstream wal(filename);
+    std::string line;
+    while (std::getline(wal, line)) {
+        if (line.empty()) continue;
+        try {
+            auto entry = json::parse(line);
+            if (entry.contains("idempotency_key")) {
+                rememberResponse(entry["idempotency_key"], entry["response"]);
+                replayed++;
+                continue;
+            }
+            std::string plate = entry["plate"];
+            if (entry.contains("data")) {
+                // 旧版本日志记录的是整个车辆对象
+                loadVehicleJson(plate, entry["data"], legacyHistory);
+            } else {
+                VehicleRecord record;
+                uint8_t flags = entry["flags"];
+                record.inside = flags & 1;
+                record.monthly = (flags >> 1) & 1;
+                record.blacklisted = (flags >> 2) & 1;
+                record.entryTime = entry["entry_time"];
+                record.monthlyExpiry = entry["monthly_expiry"];
+                auto& shard = shards[shardIndex(plate)];
+                applyRecord(shard, internPlate(shard, plate), record);
+                // 写完日志后、写入历史前崩溃的事件在这里补上; 正在迁移旧数据时并入待导入列表以保持时间顺序
+                auto event = static_cast<VehicleEvent>(entry.value("event", 0));
+                if (event != VehicleEvent::None && legacyHistory) {
+                    (*legacyHistory)[plate].push_back({entry["time"], event, entry.value("fee", 0.0)});
+                } else if (event != VehicleEvent::None) {
+                    HistoryLog::getInstance().ensure(plate, entry["index"], event, entry["time"], entry.value("fee", 0.0));
+                }
+            }
+            replayed++;
+        } catch (...) {
+            // 崩溃时最后一条记录可能只写了一半, 丢弃即可
+            std::cerr << filename << ": skipping damaged record" << std::endl;
+        }
+    }
+    return replayed;
+}
+
+// 加载快照并重放预写日志, 服务器启动时调用一次
+bool Database::loadVehicles() {
+    // 需先打开 HistoryLog; 历史日志为空时才导入旧版本内嵌的历史记录
+    std::map<std::string, json> legacyHistory;
+    auto* legacy = HistoryLog::getInstance().empty() ? &legacyHistory : nullptr;
+
+    json snapshot = readJson(VEHICLES_FILE);
+    if (snapshot.is_object()) {
+        for (auto& [plate, data] : snapshot.items()) {
+            loadVehicleJson(plate, data, legacy);
+        }
+    }
+
+    json saved = readJson(IDEMPOTENCY_FILE);
+    if (saved.is_array()) {
+        for (const auto& item : saved) {
+            if (item.is_array() && item.size() == 2) rememberResponse(item[0], item[1]);
+        }
+    }
+
+    // 上次快照若未完成, 轮换出去的旧日志仍在, 需先于当前日志重放
+    // 并入旧日志后、删除前崩溃时同一段记录会重放两次, 记录的是完整状态, 事件按序号去重, 结果不变
+    size_t replayed = replayWal(VEHICLES_WAL_OLD, legacy) + replayWal(VEHICLES_WAL_ROTATED, legacy) +
+                      replayWal(VEHICLES_WAL, legacy);
+    if (!legacyHistory.empty()) {
+        importLegacyHistory(legacyHistory);
+        // 写一次新格式快照, 旧的历史字段随之移除
+        replayed++;
+    }
+    // 加载过程中的在场索引不可靠, 全部加载完后统一重建
+    checkInsideLocked();
+
+    walFd = ::open(VEHICLES_WAL, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (walFd < 0) {
+        std::cerr << "Error: Could not open vehicles.wal." << std::endl;
+        return false;
+    }
+    walRecords = replayed;
+    // 把重放过的日志合并进快照, 让下次启动更快
+    if (replayed > 0 && !snapshotVehicles()) return false;
+    snapshotThread = std::thread(&Database::snapshotLoop, this);
+    return true;
+}
+
+std::vector<std::string> Database::getPlates() {
+    std::vector<std::string> plates;
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        plates.insert(plates.end(), shard.plates.begin(), shard.plates.end());
+    }
+    return plates;
+}
+
+std::vector<std::string> Database::getInsidePlates() {
+    std::vector<std::string> plates;
+    plates.reserve(insideCount);
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (uint32_t slot : shard.inside) {
+            plates.push_back(shard.plates[slot]);
+        }
+    }
+    return plates;
+}
+
+size_t Database::getInsideCount() const {
+    return insideCount;
+}
+
+bool Database::verifyInsideIndex() {
+    std::unique_lock<std::recursive_mutex> locks[SHARD_COUNT];
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        locks[i] = std::unique_lock<std::recursive_mutex>(plateLocks[i]);
+    }
+    return checkInsideLocked();
+}
+
+// 按全量数据重新计算在场集合并与索引比较; 调用方需保证没有并发修改
+bool Database::checkInsideLocked() {
+    bool consistent = true;
+    size_t count = 0;
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        std::unordered_set<uint32_t> inside;
+        for (uint32_t slot = 0; slot < shard.flags.size(); slot++) {
+            if (shard.flags[slot] & FLAG_INSIDE) inside.insert(slot);
+        }
+        if (inside != shard.inside) {
+            consistent = false;
+            shard.inside.swap(inside);
+        }
+        count += shard.inside.size();
+    }
+    if (count != insideCount) consistent = false;
+    insideCount = count;
+    return consistent;
+}
+
+bool Database::getVehicle(const std::string& plate, VehicleRecord& out) {
+    auto& shard = shards[shardIndex(plate)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.slots.find(plate);
+    if (it == shard.slots.end()) return false;
+    out = loadRecord(shard, it->second);
+    return true;
+}
+
+// 当前线程正在进行的批量提交, 见 beginBatch
+struct Database::PendingBatch {
+    int depth = 1;
+    std::string wal;
+    size_t records = 0;
+    std::vector<PendingEvent> events;
+    // events 中各事件在其车牌历史中的序号
+    std::vector<size_t> eventIndexes;
+    // 本批次中各车牌尚未写入 HistoryLog 的事件数, 用于计算日志中的 index
+    std::unordered_map<std::string, size_t> pendingHistory;
+    // 各车牌在批次开始前的状态, 提交失败时恢复; 第二个值表示原来是否存在
+    std::unordered_map<std::string, std::pair<VehicleRecord, bool>> originals;
+    // 提交成功后才加入幂等表的响应
+    std::vector<std::pair<std::string, std::string>> responses;
+};
+
+static thread_local std::unique_ptr<Database::PendingBatch> currentBatch;
+
+// 调用方需持有该车牌的 lockPlate, 保证日志顺序与内存状态一致
+bool Database::saveVehicle(const std::string& plate, const VehicleRecord& record, VehicleEvent event, int64_t eventTime, double fee) {
+    PendingBatch* batch = currentBatch.get();
+    json entry = {
+        {"plate", plate},
+        {"flags", record.inside | (record.monthly << 1) | (record.blacklisted << 2)},
+        {"entry_time", record.entryTime},
+        {"monthly_expiry", record.monthlyExpiry}
+    };
+    size_t index = 0;
+    if (event != VehicleEvent::None) {
+        entry["event"] = static_cast<int>(event);
+        entry["time"] = eventTime;
+        entry["fee"] = fee;
+        // 调用方持有车牌锁, 该车牌的历史条数在此期间不会变化
+        index = nextHistoryIndex(plate);
+        if (batch) index += batch->pendingHistory[plate];
+        entry["index"] = index;
+    }
+    std::string line = entry.dump() + "\n";
+    if (batch) {
+        if (!batch->originals.count(plate)) {
+            VehicleRecord original;
+            bool existed = getVehicle(plate, original);
+            batch->originals.emplace(plate, std::make_pair(original, existed));
+        }
+        batch->wal += line;
+        batch->records++;
+    } else if (!appendWal(line, 1)) {
+        return false;
+    }
+    {
+        auto& shard = shards[shardIndex(plate)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        applyRecord(shard, internPlate(shard, plate), record);
+    }
+    if (event == VehicleEvent::None) return true;
+    PendingEvent pending{plate, event, eventTime, fee};
+    if (batch) {
+        batch->events.push_back(pending);
+        batch->eventIndexes.push_back(index);
+        batch->pendingHistory[plate]++;
+        return true;
+    }
+    // 状态以预写日志为准, 历史写入失败不让本次操作失败: 记下事件, 之后补写, 快照在补写成功前保留旧日志
+    if (!retryHistory(&plate) || !HistoryLog::getInstance().append(plate, event, eventTime, fee)) {
+        std::cerr << "Error: Could not append history of " << plate << std::endl;
+        recordFailedHistory(pending, index);
+    }
+    return true;
+}
+
+size_t Database::nextHistoryIndex(const std::string& plate) {
+    std::lock_guard<std::mutex> lock(historyRetryMutex);
+    size_t index = HistoryLog::getInstance().count(plate);
+    for (const auto& failed : failedHistory) {
+        if (failed.first.plate == plate) index++;
+    }
+    return index;
+}
+
+void Database::recordFailedHistory(const PendingEvent& event, size_t index) {
+    std::lock_guard<std::mutex> lock(historyRetryMutex);
+    failedHistory.emplace_back(event, index);
+}
+
+// 按发生顺序补写; 某车牌有一条补写失败时, 它之后的事件留到下次
+bool Database::retryHistory(const std::string* plate) {
+    std::lock_guard<std::mutex> lock(historyRetryMutex);
+    std::unordered_set<std::string> blocked;
+    auto& history = HistoryLog::getInstance();
+    for (auto it = failedHistory.begin(); it != failedHistory.end();) {
+        const PendingEvent& event = it->first;
+        if ((plate && event.plate != *plate) || blocked.count(event.plate)) {
+            ++it;
+        } else if (history.ensure(event.plate, it->second, event.type, event.time, event.fee)) {
+            it = failedHistory.erase(it);
+        } else {
+            blocked.insert(event.plate);
+            ++it;
+        }
+    }
+    return blocked.empty();
+}
+
+std::vector<std::unique_lock<std::recursive_mutex>> Database::lockPlates(const std::vector<std::string>& plates) {
+    std::vector<size_t> stripes;
+    for (const auto& plate : plates) stripes.push_back(shardIndex(plate));
+    // 按条带下标顺序加锁, 多个批次并发时不会互相死锁
+    std::sort(stripes.begin(), stripes.end());
+    stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+    std::vector<std::unique_lock<std::recursive_mutex>> locks;
+    for (size_t stripe : stripes) locks.emplace_back(plateLocks[stripe]);
+    return locks;
+}
+
+// 批次可以嵌套, 只有最外层的 commitBatch 真正提交
+void Database::beginBatch() {
+    if (currentBatch) {
+        currentBatch->depth++;
+        return;
+    }
+    currentBatch.reset(new PendingBatch());
+}
+
+// 整批日志一次写入并落盘, 成功后再写历史; 失败时把内存状态恢复到批次开始前
+bool Database::commitBatch() {
+    if (currentBatch && --currentBatch->depth > 0) return true;
+    std::unique_ptr<PendingBatch> batch = std::move(currentBatch);
+    if (!batch || batch->records == 0) return true;
+    if (!appendWal(batch->wal, batch->records)) {
+        for (const auto& [plate, original] : batch->originals) {
+            auto& shard = shards[shardIndex(plate)];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            // 批次中新出现的车牌无法从分片中删除, 恢复为空记录, 重启后不会出现
+            applyRecord(shard, internPlate(shard, plate), original.second ? original.first : VehicleRecord());
+        }
+        return false;
+    }
+    for (const auto& [key, response] : batch->responses) rememberResponse(key, response);
+    // 与单条写入相同: 有事件尚未补写成功的车牌, 本批次的事件也排在后面等待补写
+    std::vector<PendingEvent> events;
+    std::vector<size_t> indexes;
+    for (size_t i = 0; i < batch->events.size(); i++) {
+        if (retryHistory(&batch->events[i].plate)) {
+            events.push_back(batch->events[i]);
+            indexes.push_back(batch->eventIndexes[i]);
+        } else {
+            recordFailedHistory(batch->events[i], batch->eventIndexes[i]);
+        }
+    }
+    if (!events.empty() && !HistoryLog::getInstance().appendBatch(events)) {
+        std::cerr << "Error: Could not append history batch" << std::endl;
+        // 整批没有写入, 之后按序号逐条补写
+        for (size_t i = 0; i < events.size(); i++) recordFailedHistory(events[i], indexes[i]);
+    }
+    return true;
+}
+
+bool Database::findResponse(const std::string& key, std::string& response) {
+    std::lock_guard<std::mutex> lock(responsesMutex);
+    auto it = responses.find(key);
+    if (it == responses.end()) return false;
+    response = it->second;
+    return true;
+}
+
+// 批次中只记入日志缓冲, 提交成功后才能被查到
+bool Database::saveResponse(const std::string& key, const std::string& response) {
+    std::string line = json{{"idempotency_key", key}, {"response", response}}.dump() + "\n";
+    if (PendingBatch* batch = currentBatch.get()) {
+        batch->wal += line;
+        batch->records++;
+        batch->responses.emplace_back(key, response);
+        return true;
+    }
+    if (!appendWal(line, 1)) return false;
+    rememberResponse(key, response);
+    return true;
+}
+
+void Database::rememberResponse(const std::string& key, const std::string& response) {
+    std::lock_guard<std::mutex> lock(responsesMutex);
+    if (!responses.emplace(key, response).second) return;
+    responseOrder.push_back(key);
+    if (responseOrder.size() > IDEMPOTENCY_CAPACITY) {
+        responses.erase(responseOrder.front());
+        responseOrder.pop_front();
+    }
+}
+
+// 追加若干条日志记录并落盘, 累计条数够了就唤醒快照线程
+// 写入或落盘失败时截回写入前的长度, 不留下半条记录让下一条接在它后面
+bool Database::appendWal(const std::string& data, size_t records) {
+    std::lock_guard<std::mutex> lock(walMutex);
+    if (walFd < 0 || walFailed) return false;
+    off_t offset = ::lseek(walFd, 0, SEEK_END);
+    if (offset < 0) return false;
+    if (!writeAll(walFd, data.data(), data.size()) || ::fdatasync(walFd) != 0) {
+        if (::ftruncate(walFd, offset) != 0) {
+            std::cerr << "Error: Could not roll back vehicles.wal, rejecting writes until the next snapshot." << std::endl;
+            walFailed = true;
+            std::lock_guard<std::mutex> snapLock(snapshotMutex);
+            snapshotRequested = true;
+            snapshotCv.notify_one();
+        }
+        return false;
+    }
+    walRecords += records;
+    if (walRecords >= SNAPSHOT_INTERVAL) {
+        std::lock_guard<std::mutex> snapLock(snapshotMutex);
+        snapshotRequested = true;
+        snapshotCv.notify_one();
+    }
+    return true;
+}
+
+void Database::snapshotLoop() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(snapshotMutex);
+            snapshotCv.wait(lock, [this] { return snapshotRequested || snapshotStop; });
+            if (snapshotStop) return;
+            snapshotRequested = false;
+        }
+        if (!snapshotVehicles()) {
+            std::cerr << "Error: Could not write vehicles snapshot." << std::endl;
+        }
+    }
 }
 
-json Database::getVehicles() {
-    std::lock_guard<std::mutex> lock(vehiclesMutex);
-    return readJson("vehicles.json");
+// 把当前目录中的创建、改名和删除落盘
+static bool syncDirectory() {
+    int fd = ::open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
 }
 
-bool Database::saveVehicles(const json& data) {
-    std::lock_guard<std::mutex> lock(vehiclesMutex);
-    return writeJson("vehicles.json", data);
-}
\ No newline at end of file
+// 写临时文件并 fsync 后原子替换目标文件
+static bool writeFileSynced(const std::string& path, const std::string& data) {
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    bool ok = writeAll(fd, data.data(), data.size()) && ::fsync(fd) == 0;
+    ::close(fd);
+    if (!ok) return false;
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    return !ec && syncDirectory();
+}
+
+// 把日志 from 并入 to 并落盘后删除 from; to 不存在时直接改名
+static bool mergeWal(const char* from, const char* to) {
+    std::error_code ec;
+    if (!std::filesystem::exists(from, ec)) return true;
+    if (!std::filesystem::exists(to, ec)) {
+        std::filesystem::rename(from, to, ec);
+        return !ec && syncDirectory();
+    }
+    int in = ::open(from, O_RDONLY | O_CLOEXEC);
+    int out = ::open(to, O_RDWR | O_APPEND | O_CLOEXEC);
+    bool ok = in >= 0 && out >= 0;
+    // to 末尾若是写了一半的记录, 先补上换行, 以免与 from 的第一条记录连成一行
+    off_t size = ok ? ::lseek(out, 0, SEEK_END) : -1;
+    char last = '\n';
+    if (size > 0 && ::pread(out, &last, 1, size - 1) == 1 && last != '\n') ok = writeAll(out, "\n", 1);
+    char buf[65536];
+    while (ok) {
+        ssize_t n = ::read(in, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ok = n == 0;
+            break;
+        }
+        ok = writeAll(out, buf, static_cast<size_t>(n));
+    }
+    ok = ok && ::fsync(out) == 0;
+    if (in >= 0) ::close(in);
+    if (out >= 0) ::close(out);
+    if (!ok) return false;
+    std::filesystem::remove(from, ec);
+    return !ec && syncDirectory();
+}
+
+// 写快照: 持有全部车牌锁时复制各列数据并把日志改名轮换, 释放锁后再并入旧日志、生成 JSON 写盘
+// 快照原子替换成功前崩溃, 重启时旧快照 + 旧日志 + 新日志仍能恢复全部修改
+bool Database::snapshotVehicles() {
+    std::lock_guard<std::mutex> snapshotLock(snapshotWriteMutex);
+    // 上次失败的快照留下的轮换日志先并入旧日志, 腾出位置
+    if (!mergeWal(VEHICLES_WAL_ROTATED, VEHICLES_WAL_OLD)) return false;
+    struct ShardCopy {
+        std::deque<std::string> plates;
+        std::vector<uint8_t> flags;
+        std::vector<int64_t> entryTimes;
+        std::vector<int64_t> monthlyExpiries;
+    };
+    std::vector<ShardCopy> copies(SHARD_COUNT);
+    json savedResponses = json::array();
+    bool historyComplete = true;
+    {
+        std::unique_lock<std::recursive_mutex> locks[SHARD_COUNT];
+        for (size_t i = 0; i < SHARD_COUNT; i++) {
+            locks[i] = std::unique_lock<std::recursive_mutex>(plateLocks[i]);
+        }
+        if (!checkInsideLocked()) {
+            std::cerr << "Warning: inside index was inconsistent and has been rebuilt." << std::endl;
+        }
+        // 旧日志是补写失败事件的唯一记录, 补写成功前不能删除
+        historyComplete = retryHistory(nullptr);
+        for (size_t i = 0; i < SHARD_COUNT; i++) {
+            std::lock_guard<std::mutex> lock(shards[i].mutex);
+            copies[i] = {shards[i].plates, shards[i].flags, shards[i].entryTimes, shards[i].monthlyExpiries};
+        }
+        {
+            std::lock_guard<std::mutex> lock(responsesMutex);
+            for (const auto& key : responseOrder) savedResponses.push_back({key, responses[key]});
+        }
+
+        // 持锁期间只改名并新建日志, 复制日志内容留到释放锁之后
+        std::lock_guard<std::mutex> lock(walMutex);
+        std::error_code ec;
+        std::filesystem::rename(VEHICLES_WAL, VEHICLES_WAL_ROTATED, ec);
+        if (ec) return false;
+        int fd = ::open(VEHICLES_WAL, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            std::filesystem::rename(VEHICLES_WAL_ROTATED, VEHICLES_WAL, ec);
+            return false;
+        }
+        if (walFd >= 0) ::close(walFd);
+        walFd = fd;
+        walRecords = 0;
+        walFailed = false;
+        // 改名和新日志都落盘后才能往新日志写入, 否则崩溃后新记录可能随目录项一起丢失
+        if (!syncDirectory()) return false;
+    }
+    if (!mergeWal(VEHICLES_WAL_ROTATED, VEHICLES_WAL_OLD)) return false;
+
+    json snapshot = json::object();
+    for (const auto& copy : copies) {
+        for (size_t slot = 0; slot < copy.plates.size(); slot++) {
+            uint8_t flags = copy.flags[slot];
+            snapshot[copy.plates[slot]] = {
+                {"is_inside", (flags & FLAG_INSIDE) != 0},
+                {"is_monthly", (flags & FLAG_MONTHLY) != 0},
+                {"is_blacklisted", (flags & FLAG_BLACKLISTED) != 0},
+                {"entry_time", copy.entryTimes[slot]},
+                {"monthly_expiry", copy.monthlyExpiries[slot]}
+            };
+        }
+    }
+
+    // 两个文件都替换成功后才删除旧日志, 中途崩溃时重放旧日志即可补齐
+    if (!writeFileSynced(IDEMPOTENCY_FILE, savedResponses.dump())) return false;
+    if (!writeFileSynced(VEHICLES_FILE, snapshot.dump())) return false;
+    if (!historyComplete) {
+        std::cerr << "Warning: some history events are not written yet, keeping " << VEHICLES_WAL_OLD << std::endl;
+        return true;
+    }
+    std::error_code ec;
+    std::filesystem::remove(VEHICLES_WAL_OLD, ec);
+    return !ec && syncDirectory();
+}
@@ -0,0 +1,55 @@
+#include "../include/frame_format.hpp"
+
+bool parsePixelFormat(const std::string& name, PixelFormat& format)
+{
+    if (name == "bgr24") {
+        format = PixelFormat::BGR24;
+    } else if (name == "rgb24") {
+        format = PixelFormat::RGB24;
+    } else if (name == "gray") {
+        format = PixelFormat::GRAY;
+    } else if (name == "yuyv422") {
+        format = PixelFormat::YUYV422;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+int bytesPerPixel(PixelFormat format)
+{
+    switch (format) {
+        case PixelFormat::GRAY: return 1;
+        case PixelFormat::YUYV422: return 2;
+        default: return 3;
+    }
+}
+
+int frameMatType(PixelFormat format)
+{
+    switch (format) {
+        case PixelFormat::GRAY: return CV_8UC1;
+        case PixelFormat::YUYV422: return CV_8UC2;
+        default: return CV_8UC3;
+    }
+}
+
+void frameToGray(const cv::Mat& frame, PixelFormat format, cv::Mat& gray)
+{
+    switch (format) {
+        case PixelFormat::BGR24: cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY); break;
+        case PixelFormat::RGB24: cv::cvtColor(frame, gray, cv::COLOR_RGB2GRAY); break;
+        case PixelFormat::YUYV422: cv::cvtColor(frame, gray, cv::COLOR_YUV2GRAY_YUY2); break;
+        case PixelFormat::GRAY: gray = frame; break;
+    }
+}
+
+void frameToBgr(const cv::Mat& frame, PixelFormat format, cv::Mat& bgr)
+{
+    switch (format) {
+        case PixelFormat::BGR24: bgr = frame; break;
+        case PixelFormat::RGB24: cv::cvtColor(frame, bgr, cv::COLOR_RGB2BGR); break;
+        case PixelFormat::YUYV422: cv::cvtColor(frame, bgr, cv::COLOR_YUV2BGR_YUY2); break;
+        case PixelFormat::GRAY: cv::cvtColor(frame, bgr, cv::COLOR_GRAY2BGR); break;
+    }
+}
@@ -0,0 +1,241 @@
+#include "../include/frame_source.hpp"
+#include <iostream>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// 管道、FIFO 或设备: 用 read() 直接读进帧缓冲, 不经过 iostream 的缓冲
+class FdSource : public FrameSource {
+public:
+    FdSource(int fd, bool owned, int width, int height, PixelFormat format) : fd(fd), owned(owned)
+    {
+        frameWidth = width;
+        frameHeight = height;
+        pixelFormat = format;
+    }
+
+    ~FdSource() override
+    {
+        if (owned && fd >= 0) ::close(fd);
+    }
+
+    bool open() override
+    {
+        discard.resize(frameSize());
+        return true;
+    }
+
+    bool read(FrameBuffer& frame, const std::atomic<bool>& stop) override
+    {
+        if (frame.storage.size() < frameSize()) frame.storage.resize(frameSize());
+        if (!readFull(frame.storage.data(), frameSize(), stop)) return false;
+        frame.data = frame.storage.data();
+        return true;
+    }
+
+    bool skip(const std::atomic<bool>& stop) override
+    {
+        return readFull(discard.data(), discard.size(), stop);
+    }
+
+    bool live() const override { return true; }
+
+private:
+    int fd;
+    bool owned;
+    // 丢帧时读到这里, 保持输入管道畅通
+    std::vector<unsigned char> discard;
+
+    // 读满 size 字节; 等待数据时每 100ms 检查一次是否要退出
+    bool readFull(unsigned char* data, size_t size, const std::atomic<bool>& stop)
+    {
+        size_t got = 0;
+        while (got < size) {
+            if (stop.load(std::memory_order_relaxed)) return false;
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            int r = ::poll(&pfd, 1, 100);
+            if (r < 0 && errno != EINTR) return false;
+            if (r <= 0) continue;
+            ssize_t n = ::read(fd, data + got, size - got);
+            if (n < 0) {
+                if (errno == EINTR || errno == EAGAIN) continue;
+                return false;
+            }
+            if (n == 0) return false;
+            got += static_cast<size_t>(n);
+        }
+        return true;
+    }
+};
+
+// 原始视频文件: 整体只读映射到内存, 帧直接指向映射区域, 不复制
+class MappedFileSource : public FrameSource {
+public:
+    MappedFileSource(const std::string& path, int width, int height, PixelFormat format) : path(path)
+    {
+        frameWidth = width;
+        frameHeight = height;
+        pixelFormat = format;
+    }
+
+    ~MappedFileSource() override
+    {
+        if (map) ::munmap(map, length);
+    }
+
+    bool open() override
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "无法打开视频文件: " << path << " " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < frameSize()) {
+            std::cerr << "视频文件不足一帧: " << path << std::endl;
+            ::close(fd);
+            return false;
+        }
+        length = static_cast<size_t>(st.st_size);
+        void* p = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            std::cerr << "无法映射视频文件: " << path << " " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        map = static_cast<unsigned char*>(p);
+        ::madvise(map, length, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    bool read(FrameBuffer& frame, const std::atomic<bool>&) override
+    {
+        if (offset + frameSize() > length) return false;
+        frame.data = map + offset;
+        offset += frameSize();
+        prefetch();
+        return true;
+    }
+
+    bool skip(const std::atomic<bool>&) override
+    {
+        if (offset + frameSize() > length) return false;
+        offset += frameSize();
+        return true;
+    }
+
+    bool live() const override { return false; }
+    bool zeroCopy() const override { return true; }
+
+private:
+    std::string path;
+    unsigned char* map = nullptr;
+    size_t length = 0;
+    size_t offset = 0;
+
+    // 提前让内核读入下一帧, 缺页不落在检测线程上
+    void prefetch()
+    {
+        static const size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        if (offset >= length) return;
+        size_t start = offset / pageSize * pageSize;
+        size_t end = std::min(offset + frameSize(), length);
+        ::madvise(map + start, end - start, MADV_WILLNEED);
+    }
+};
+
+// 录像文件、摄像头编号或网络流, 由 VideoCapture 解码为 bgr24
+class CaptureSource : public FrameSource {
+public:
+    explicit CaptureSource(const std::string& path) : path(path) {}
+
+    bool open() override
+    {
+        bool isIndex = !path.empty() && std::all_of(path.begin(), path.end(), ::isdigit);
+        bool opened = isIndex ? capture.open(std::stoi(path)) : capture.open(path);
+        if (!opened || !capture.isOpened()) {
+            std::cerr << "VideoCapture 无法打开: " << path << std::endl;
+            return false;
+        }
+        frameWidth = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_WIDTH));
+        frameHeight = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT));
+        pixelFormat = PixelFormat::BGR24;
+        if (frameWidth <= 0 || frameHeight <= 0) {
+            std::cerr << "无法取得视频尺寸: " << path << std::endl;
+            return false;
+        }
+        isLive = isIndex || path.find("://") != std::string::npos || path.compare(0, 5, "/dev/") == 0;
+        return true;
+    }
+
+    bool read(FrameBuffer& frame, const std::atomic<bool>&) override
+    {
+        if (frame.storage.size() < frameSize()) frame.storage.resize(frameSize());
+        // 尺寸和类型一致时解码结果直接写入帧缓冲
+        cv::Mat target(frameHeight, frameWidth, CV_8UC3, frame.storage.data());
+        cv::Mat image = target;
+        if (!capture.read(image)) return false;
+        if (image.data != target.data) {
+            if (image.rows != frameHeight || image.cols != frameWidth || image.type() != CV_8UC3) {
+                std::cerr << "视频画面尺寸变化: " << path << std::endl;
+                return false;
+            }
+            image.copyTo(target);
+        }
+        frame.data = frame.storage.data();
+        return true;
+    }
+
+    bool skip(const std::atomic<bool>&) override
+    {
+        return capture.grab();
+    }
+
+    bool live() const override { return isLive; }
+
+private:
+    std::string path;
+    cv::VideoCapture capture;
+    bool isLive = false;
+};
+
+std::unique_ptr<FrameSource> openFrameSource(const std::string& type, const std::string& path,
+                                             int width, int height, PixelFormat format)
+{
+    std::unique_ptr<FrameSource> source;
+    if (type == "capture") {
+        source.reset(new CaptureSource(path));
+    } else if (type == "raw") {
+        struct stat st;
+        if (path == "-") {
+            source.reset(new FdSource(STDIN_FILENO, false, width, height, format));
+        } else if (::stat(path.c_str(), &st) != 0) {
+            std::cerr << "无法打开视频来源: " << path << " " << std::strerror(errno) << std::endl;
+            return nullptr;
+        } else if (S_ISREG(st.st_mode)) {
+            source.reset(new MappedFileSource(path, width, height, format));
+        } else {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                std::cerr << "无法打开视频来源: " << path << " " << std::strerror(errno) << std::endl;
+                return nullptr;
+            }
+            source.reset(new FdSource(fd, true, width, height, format));
+        }
+    } else {
+        std::cerr << "未知的视频来源类型: " << type << std::endl;
+        return nullptr;
+    }
+
+    if (!source->open()) return nullptr;
+    return source;
+}
@@ -0,0 +1,346 @@
+#include "../include/history.hpp"
+#include <filesystem>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// 截掉写入失败留下的字节; 截不掉时进程内仍然正确 (下次写入会覆盖), 但重启后可能读到它们, 因此报错
+static void truncateTo(int fd, off_t size) {
+    if (::ftruncate(fd, size) != 0) {
+        std::cerr << "Error: Could not truncate history file after a failed write" << std::endl;
+    }
+}
+
+// 从 offset 起写满 len 字节, 被信号打断时继续
+// 文件不用 O_APPEND 打开, 写入位置由已提交的长度决定, 失败残留的字节会被下一次写入覆盖
+static bool writeAllAt(int fd, const char* p, size_t len, off_t offset) {
+    while (len > 0) {
+        ssize_t n = ::pwrite(fd, p, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= static_cast<size_t>(n);
+        offset += n;
+    }
+    return true;
+}
+
+HistoryLog& HistoryLog::getInstance() {
+    static HistoryLog instance;
+    return instance;
+}
+
+HistoryLog::~HistoryLog() {
+    if (platesFd >= 0) ::close(platesFd);
+    for (int fd : segmentFds) ::close(fd);
+}
+
+std::string HistoryLog::segmentPath(size_t segment) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%06zu.seg", segment);
+    return dir + name;
+}
+
+bool HistoryLog::openSegment(size_t segment) {
+    int fd = ::open(segmentPath(segment).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    segmentFds.push_back(fd);
+    return true;
+}
+
+// 加载车牌字典并扫描全部分段重建每个车牌的事件索引, 启动时调用一次
+bool HistoryLog::open(const std::string& directory) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    dir = directory;
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+
+    // 字典每行一个车牌, 行号即车牌 ID; 崩溃留下的半行丢弃
+    std::string platesPath = dir + "/plates.dat";
+    {
+        std::ifstream in(platesPath, std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        size_t start = 0, valid = 0;
+        for (size_t pos; (pos = content.find('\n', start)) != std::string::npos; start = pos + 1) {
+            std::string plate = content.substr(start, pos - start);
+            plateIds.emplace(plate, static_cast<uint32_t>(plateNames.size()));
+            plateNames.push_back(plate);
+            valid = pos + 1;
+        }
+        if (valid != content.size()) std::filesystem::resize_file(platesPath, valid, ec);
+        platesSize = static_cast<off_t>(valid);
+    }
+    plateEvents.resize(plateNames.size());
+    platesFd = ::open(platesPath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (platesFd < 0) {
+        std::cerr << "Error: Could not open " << platesPath << std::endl;
+        return false;
+    }
+
+    for (size_t segment = 0; std::filesystem::exists(segmentPath(segment)); segment++) {
+        if (!openSegment(segment)) return false;
+        int fd = segmentFds.back();
+        struct stat st;
+        if (::fstat(fd, &st) != 0) return false;
+        // 最后一条记录可能只写了一半, 截掉到整条记录边界
+        off_t size = st.st_size - st.st_size % static_cast<off_t>(sizeof(HistoryEvent));
+        if (size != st.st_size && ::ftruncate(fd, size) != 0) return false;
+
+        std::vector<HistoryEvent> events(static_cast<size_t>(size) / sizeof(HistoryEvent));
+        if (size > 0 && ::pread(fd, events.data(), static_cast<size_t>(size), 0) != size) return false;
+        for (const auto& event : events) {
+            if (event.plateId < plateEvents.size()) plateEvents[event.plateId].push_back(eventCount);
+            // 时间索引按块覆盖所有记录, 字典中没有的车牌在查询时过滤
+            indexEvent(event, eventCount);
+            eventCount++;
+        }
+        // 只有最后一个分段可能未写满
+        if (static_cast<uint64_t>(size) / sizeof(HistoryEvent) < SEGMENT_EVENTS) break;
+    }
+    if (segmentFds.empty() && !openSegment(0)) return false;
+    return true;
+}
+
+bool HistoryLog::empty() {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return eventCount == 0;
+}
+
+// 查找或登记车牌 ID; 新车牌先写入字典, sync 为 false 时由调用方稍后统一落盘
+// 写入失败时截回原长度, 字典的行号始终与车牌 ID 一致
+bool HistoryLog::internLocked(const std::string& plate, bool sync, uint32_t& id) {
+    auto it = plateIds.find(plate);
+    if (it != plateIds.end()) {
+        id = it->second;
+        return true;
+    }
+    std::string line = plate + "\n";
+    if (!writeAllAt(platesFd, line.data(), line.size(), platesSize) || (sync && ::fdatasync(platesFd) != 0)) {
+        truncateTo(platesFd, platesSize);
+        return false;
+    }
+    platesSize += static_cast<off_t>(line.size());
+    id = static_cast<uint32_t>(plateNames.size());
+    plateIds.emplace(plate, id);
+    plateNames.push_back(plate);
+    plateEvents.emplace_back();
+    return true;
+}
+
+// 撤销 count 之后登记的车牌, 字典截回 size 字节; 这些车牌还没有任何事件
+void HistoryLog::dropPlatesLocked(size_t count, off_t size) {
+    for (size_t id = count; id < plateNames.size(); ++id) plateIds.erase(plateNames[id]);
+    plateNames.resize(count);
+    plateEvents.resize(count);
+    truncateTo(platesFd, size);
+    platesSize = size;
+}
+
+// 把事件写在已提交的事件之后并逐个分段落盘, 全部成功后才计入 eventCount 和索引
+// 任何一步失败都截掉本次写入的部分, 保证第 n 条事件总在 n * sizeof(HistoryEvent) 处, 调用方重试不会重复
+bool HistoryLog::commitEventsLocked(const std::vector<HistoryEvent>& events) {
+    std::vector<size_t> touched;
+    bool ok = true;
+    for (size_t i = 0; ok && i < events.size();) {
+        uint64_t seq = eventCount + i;
+        size_t segment = seq / SEGMENT_EVENTS;
+        if (segment >= segmentFds.size() && !openSegment(segment)) {
+            ok = false;
+            break;
+        }
+        size_t n = std::min<size_t>(events.size() - i, SEGMENT_EVENTS - seq % SEGMENT_EVENTS);
+        off_t offset = static_cast<off_t>((seq % SEGMENT_EVENTS) * sizeof(HistoryEvent));
+        touched.push_back(segment);
+        ok = writeAllAt(segmentFds[segment], reinterpret_cast<const char*>(&events[i]), n * sizeof(HistoryEvent), offset);
+        i += n;
+    }
+    for (size_t segment : touched) {
+        if (ok && ::fdatasync(segmentFds[segment]) != 0) ok = false;
+    }
+    if (!ok) {
+        size_t first = eventCount / SEGMENT_EVENTS;
+        for (size_t segment : touched) {
+            off_t size = segment == first ? static_cast<off_t>((eventCount % SEGMENT_EVENTS) * sizeof(HistoryEvent)) : 0;
+            truncateTo(segmentFds[segment], size);
+        }
+        return false;
+    }
+    for (const auto& event : events) {
+        plateEvents[event.plateId].push_back(eventCount);
+        indexEvent(event, eventCount++);
+    }
+    return true;
+}
+
+static HistoryEvent makeEvent(uint32_t id, VehicleEvent type, int64_t time, double fee) {
+    HistoryEvent event = {};
+    event.plateId = id;
+    event.type = static_cast<uint8_t>(type);
+    event.time = time;
+    event.fee = fee;
+    return event;
+}
+
+bool HistoryLog::appendLocked(const std::string& plate, VehicleEvent type, int64_t time, double fee) {
+    // 先落盘字典再写事件, 保证事件引用的车牌 ID 一定存在
+    uint32_t id;
+    return internLocked(plate, true, id) && commitEventsLocked({makeEvent(id, type, time, fee)});
+}
+
+// 先登记全部新车牌并落盘字典一次, 再写入全部事件, 每个涉及的分段各落盘一次
+// 整批要么全部写入, 要么全部不写: 失败时撤销本批新登记的车牌和已写入的事件
+bool HistoryLog::appendBatch(const std::vector<PendingEvent>& events) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    size_t plateCount = plateNames.size();
+    off_t platesSizeBefore = platesSize;
+    std::vector<HistoryEvent> records;
+    records.reserve(events.size());
+    for (const auto& pending : events) {
+        uint32_t id;
+        if (!internLocked(pending.plate, false, id)) {
+            dropPlatesLocked(plateCount, platesSizeBefore);
+            return false;
+        }
+        records.push_back(makeEvent(id, pending.type, pending.time, pending.fee));
+    }
+    if (plateNames.size() > plateCount && ::fdatasync(platesFd) != 0) {
+        dropPlatesLocked(plateCount, platesSizeBefore);
+        return false;
+    }
+    // 新车牌已经落盘, 事件写入失败时留在字典里也无妨
+    return commitEventsLocked(records);
+}
+
+// 扩展事件所在块的时间范围; 事件只追加在最后一块, 只有它的 prefixMax 会变化; 调用方需持有写锁
+void HistoryLog::indexEvent(const HistoryEvent& event, uint64_t seq) {
+    size_t block = seq / BLOCK_EVENTS;
+    if (block == blocks.size()) {
+        int64_t prefixMax = blocks.empty() ? event.time : std::max(blocks.back().prefixMax, event.time);
+        blocks.push_back({event.time, event.time, prefixMax});
+        return;
+    }
+    auto& b = blocks[block];
+    b.minTime = std::min(b.minTime, event.time);
+    b.maxTime = std::max(b.maxTime, event.time);
+    b.prefixMax = std::max(b.prefixMax, event.time);
+}
+
+bool HistoryLog::append(const std::string& plate, VehicleEvent type, int64_t time, double fee) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    return appendLocked(plate, type, time, fee);
+}
+
+bool HistoryLog::ensure(const std::string& plate, size_t index, VehicleEvent type, int64_t time, double fee) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto it = plateIds.find(plate);
+    if (it != plateIds.end() && plateEvents[it->second].size() > index) return true;
+    return appendLocked(plate, type, time, fee);
+}
+
+// 调用方需持有锁
+bool HistoryLog::readEvent(uint64_t seq, HistoryEvent& event) {
+    size_t segment = seq / SEGMENT_EVENTS;
+    if (segment >= segmentFds.size()) return false;
+    off_t offset = static_cast<off_t>((seq % SEGMENT_EVENTS) * sizeof(HistoryEvent));
+    return ::pread(segmentFds[segment], &event, sizeof(event), offset) == sizeof(event);
+}
+
+size_t HistoryLog::count(const std::string& plate) {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = plateIds.find(plate);
+    return it == plateIds.end() ? 0 : plateEvents[it->second].size();
+}
+
+std::vector<HistoryEvent> HistoryLog::query(const std::string& plate, int64_t from, int64_t to,
+                                            size_t limit, size_t cursor, size_t& nextCursor) {
+    std::vector<HistoryEvent> result;
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    nextCursor = cursor;
+    auto it = plateIds.find(plate);
+    if (it == plateIds.end()) return result;
+    const auto& seqs = plateEvents[it->second];
+    for (; nextCursor < seqs.size() && result.size() < limit; nextCursor++) {
+        HistoryEvent event;
+        if (!readEvent(seqs[nextCursor], event)) break;
+        if (event.time >= from && event.time <= to) result.push_back(event);
+    }
+    return result;
+}
+
+std::vector<HistoryEvent> HistoryLog::recent(const std::string& plate, size_t limit) {
+    std::vector<HistoryEvent> result;
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = plateIds.find(plate);
+    if (it == plateIds.end()) return result;
+    const auto& seqs = plateEvents[it->second];
+    size_t start = seqs.size() > limit ? seqs.size() - limit : 0;
+    for (size_t i = start; i < seqs.size(); i++) {
+        HistoryEvent event;
+        if (readEvent(seqs[i], event)) result.push_back(event);
+    }
+    return result;
+}
+
+std::vector<std::pair<std::string, HistoryEvent>> HistoryLog::queryRange(int64_t from, int64_t to, VehicleEvent type,
+                                                                         size_t limit, size_t cursor, bool& more) {
+    std::vector<std::pair<std::string, HistoryEvent>> result;
+    more = false;
+    if (from > to) return result;
+    std::shared_lock<std::shared_mutex> lock(mutex);
+
+    // 之前的块最晚时间都早于 from, 从第一个 prefixMax >= from 的块开始找时间范围有交集的块
+    auto first = std::lower_bound(blocks.begin(), blocks.end(), from,
+                                  [](const TimeBlock& b, int64_t t) { return b.prefixMax < t; });
+    std::vector<size_t> candidates;
+    for (auto it = first; it != blocks.end(); ++it) {
+        if (it->minTime <= to && it->maxTime >= from) candidates.push_back(static_cast<size_t>(it - blocks.begin()));
+    }
+    // 按块内最早时间依次顺序读取; 只保留按 (时间, 序号) 排在最前的 cursor + limit + 1 条,
+    // 已经攒够且下一块的最早时间更晚时, 之后的块都不可能排在前面, 不再读取
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [this](size_t a, size_t b) { return blocks[a].minTime < blocks[b].minTime; });
+    size_t keep = cursor < SIZE_MAX - limit - 1 ? cursor + limit + 1 : SIZE_MAX;
+    using Match = std::pair<std::pair<int64_t, uint64_t>, HistoryEvent>;
+    auto later = [](const Match& a, const Match& b) { return a.first < b.first; };
+    std::vector<Match> matches;
+    std::vector<HistoryEvent> buffer(BLOCK_EVENTS);
+    for (size_t block : candidates) {
+        if (matches.size() == keep && blocks[block].minTime > matches.front().first.first) break;
+        uint64_t start = block * BLOCK_EVENTS;
+        size_t count = static_cast<size_t>(std::min<uint64_t>(BLOCK_EVENTS, eventCount - start));
+        off_t offset = static_cast<off_t>((start % SEGMENT_EVENTS) * sizeof(HistoryEvent));
+        ssize_t bytes = static_cast<ssize_t>(count * sizeof(HistoryEvent));
+        if (::pread(segmentFds[start / SEGMENT_EVENTS], buffer.data(), count * sizeof(HistoryEvent), offset) != bytes) {
+            continue;
+        }
+        for (size_t i = 0; i < count; i++) {
+            const HistoryEvent& event = buffer[i];
+            if (event.time < from || event.time > to || event.plateId >= plateNames.size()) continue;
+            if (type != VehicleEvent::None && event.type != static_cast<uint8_t>(type)) continue;
+            Match match = {{event.time, start + i}, event};
+            if (matches.size() < keep) {
+                matches.push_back(match);
+                std::push_heap(matches.begin(), matches.end(), later);
+            } else if (later(match, matches.front())) {
+                std::pop_heap(matches.begin(), matches.end(), later);
+                matches.back() = match;
+                std::push_heap(matches.begin(), matches.end(), later);
+            }
+        }
+    }
+    std::sort_heap(matches.begin(), matches.end(), later);
+    for (size_t i = cursor; i < matches.size() && result.size() < limit; i++) {
+        result.emplace_back(plateNames[matches[i].second.plateId], matches[i].second);
+    }
+    more = matches.size() > cursor + result.size();
+    return result;
+}
@@ -0,0 +1,392 @@
+#include "../include/log_store.hpp"
+#include "../include/utils.hpp"
+#include <filesystem>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+using json = nlohmann::json;
+
+LogStore::~LogStore() {
+    {
+        std::lock_guard<std::mutex> lock(compressMutex);
+        compressStopping = true;
+    }
+    compressReady.notify_one();
+    if (compressor.joinable()) compressor.join();
+    if (fd >= 0) ::close(fd);
+}
+
+std::string LogStore::segmentPath(size_t segment, const char* suffix) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%06zu", segment);
+    return dir + name + suffix;
+}
+
+void LogStore::SegmentIndex::note(int64_t time, const std::string& plate, const std::string& user) {
+    if (records == 0 || time < from) from = time;
+    if (records == 0 || time > to) to = time;
+    records++;
+    if (!plate.empty()) plates.insert(plate);
+    if (!user.empty()) users.insert(user);
+}
+
+bool LogStore::SegmentIndex::matches(const std::string& plate, const std::string& user, int64_t qFrom, int64_t qTo) const {
+    if (records == 0 || to < qFrom || from > qTo) return false;
+    if (!plate.empty() && !plates.count(plate)) return false;
+    if (!user.empty() && !users.count(user)) return false;
+    return true;
+}
+
+// 取出记录的时间、车牌和操作者; 车辆记录没有 user 字段, 操作者取消息开头的 [Admin:xxx] / [Bot:xxx]
+void LogStore::recordKeys(const json& log, int64_t& time, std::string& plate, std::string& user) {
+    time = 0;
+    plate.clear();
+    user.clear();
+    if (log.contains("timestamp") && log["timestamp"].is_string()) {
+        utils::parseTime(log["timestamp"].get_ref<const std::string&>(), time);
+    }
+    if (log.contains("license_plate") && log["license_plate"].is_string()) plate = log["license_plate"];
+    if (log.contains("user") && log["user"].is_string()) {
+        user = log["user"];
+    } else if (log.contains("message") && log["message"].is_string()) {
+        const std::string& message = log["message"].get_ref<const std::string&>();
+        size_t colon = message.find(':');
+        size_t end = message.find(']');
+        if (!message.empty() && message[0] == '[' && colon != std::string::npos && end != std::string::npos && colon < end) {
+            user = message.substr(colon + 1, end - colon - 1);
+        }
+    }
+}
+
+// 逐行读取日志文件, gzip 和未压缩的文件都可以读
+bool LogStore::scanFile(const std::string& path, const std::function<void(const std::string&)>& onLine) {
+    gzFile file = gzopen(path.c_str(), "rb");
+    if (!file) return false;
+    gzbuffer(file, 1 << 16);
+    char buf[1 << 14];
+    std::string line;
+    while (gzgets(file, buf, sizeof(buf))) {
+        line += buf;
+        if (!line.empty() && line.back() == '\n') {
+            line.pop_back();
+            onLine(line);
+            line.clear();
+        }
+    }
+    // 最后一行可能是崩溃时写了一半的记录, 解析失败会被跳过
+    if (!line.empty()) onLine(line);
+    gzclose(file);
+    return true;
+}
+
+bool LogStore::indexFile(const std::string& path, SegmentIndex& index) {
+    int64_t time;
+    std::string plate, user;
+    return scanFile(path, [&](const std::string& line) {
+        json log = json::parse(line, nullptr, false);
+        if (log.is_discarded() || !log.is_object()) return;
+        recordKeys(log, time, plate, user);
+        index.note(time, plate, user);
+    });
+}
+
+bool LogStore::compressFile(const std::string& src, const std::string& dst) {
+    std::ifstream in(src, std::ios::binary);
+    if (!in) return false;
+    std::string tmp = dst + ".tmp";
+    gzFile out = gzopen(tmp.c_str(), "wb6");
+    if (!out) return false;
+    char buf[1 << 16];
+    bool ok = true;
+    while (ok && in) {
+        in.read(buf, sizeof(buf));
+        std::streamsize n = in.gcount();
+        if (n > 0 && gzwrite(out, buf, static_cast<unsigned>(n)) != n) ok = false;
+    }
+    if (gzclose(out) != Z_OK) ok = false;
+    std::error_code ec;
+    if (ok) std::filesystem::rename(tmp, dst, ec);
+    if (!ok || ec) {
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+// 索引文件: {"from", "to", "records", "plates", "users"}, 时间为 epoch 秒
+bool LogStore::saveIndex(const std::string& path, const SegmentIndex& index) {
+    json data = {
+        {"from", index.from},
+        {"to", index.to},
+        {"records", index.records},
+        {"plates", index.plates},
+        {"users", index.users}
+    };
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp);
+        if (!out) return false;
+        out << data.dump();
+        if (!out) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    return !ec;
+}
+
+bool LogStore::loadIndex(const std::string& path, SegmentIndex& index) {
+    std::ifstream in(path);
+    if (!in) return false;
+    try {
+        json data = json::parse(in);
+        index.from = data.at("from");
+        index.to = data.at("to");
+        index.records = data.at("records");
+        index.plates = data.at("plates").get<std::unordered_set<std::string>>();
+        index.users = data.at("users").get<std::unordered_set<std::string>>();
+    } catch (const json::exception&) {
+        return false;
+    }
+    return true;
+}
+
+// 压缩轮换出来的 NNNNNN.log 并写索引, 查询改为读 .gz 之后才删除原文件; 中途崩溃时启动会重做
+bool LogStore::closeSegment(size_t segment, const SegmentIndex& index) {
+    std::string logPath = segmentPath(segment, ".log");
+    std::string gzPath = segmentPath(segment, ".log.gz");
+    if (!compressFile(logPath, gzPath)) {
+        std::cerr << "Error: Could not compress " << logPath << std::endl;
+        return false;
+    }
+    if (!saveIndex(segmentPath(segment, ".idx"), index)) {
+        std::cerr << "Error: Could not write index for " << gzPath << std::endl;
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
+            if (it->path == logPath) {
+                it->path = gzPath;
+                break;
+            }
+        }
+    }
+    // 已经打开 .log 的查询持有句柄, 删除不影响它们
+    std::error_code ec;
+    std::filesystem::remove(logPath, ec);
+    return true;
+}
+
+void LogStore::scheduleClose(size_t segment, const SegmentIndex& index) {
+    {
+        std::lock_guard<std::mutex> lock(compressMutex);
+        compressQueue.emplace_back(segment, index);
+    }
+    compressReady.notify_one();
+}
+
+// 压缩一个 64MB 的分段要几秒, 放在写线程上会让日志队列排满、请求线程等待
+void LogStore::compressLoop() {
+    while (true) {
+        std::pair<size_t, SegmentIndex> job;
+        {
+            std::unique_lock<std::mutex> lock(compressMutex);
+            compressReady.wait(lock, [this] { return compressStopping || !compressQueue.empty(); });
+            if (compressStopping) return;
+            job = std::move(compressQueue.front());
+            compressQueue.pop_front();
+        }
+        closeSegment(job.first, job.second);
+    }
+}
+
+bool LogStore::openActive() {
+    fd = ::open(activeFile.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Error: Could not open " << activeFile << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// 加载已关闭分段的索引, 处理上次未完成的轮换, 并扫描当前日志重建它的索引
+bool LogStore::open(const std::string& file, const std::string& directory) {
+    std::lock_guard<std::mutex> lock(mutex);
+    activeFile = file;
+    dir = directory;
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+
+    std::vector<size_t> ids;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        std::string name = entry.path().filename().string();
+        size_t dot = name.find('.');
+        if (dot != 6 || name.find_first_not_of("0123456789") != 6) continue;
+        std::string suffix = name.substr(dot);
+        if (suffix != ".log" && suffix != ".log.gz") continue;
+        ids.push_back(std::stoul(name.substr(0, dot)));
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    for (size_t id : ids) {
+        SegmentIndex index;
+        std::string logPath = segmentPath(id, ".log");
+        if (std::filesystem::exists(logPath)) {
+            // 上次没有压缩完, 先按未压缩的文件查询, 交给压缩线程重做
+            index.path = logPath;
+            indexFile(logPath, index);
+            scheduleClose(id, index);
+        } else {
+            index.path = segmentPath(id, ".log.gz");
+            if (!loadIndex(segmentPath(id, ".idx"), index)) {
+                index = SegmentIndex();
+                index.path = segmentPath(id, ".log.gz");
+                indexFile(index.path, index);
+                saveIndex(segmentPath(id, ".idx"), index);
+            }
+        }
+        segments.push_back(std::move(index));
+        nextSegment = id + 1;
+    }
+
+    active = SegmentIndex();
+    active.path = activeFile;
+    indexFile(activeFile, active);
+    activeBytes = std::filesystem::exists(activeFile) ? std::filesystem::file_size(activeFile, ec) : 0;
+    activeOpened = active.records ? active.from : utils::nowEpoch();
+    if (!compressor.joinable()) compressor = std::thread(&LogStore::compressLoop, this);
+    return openActive();
+}
+
+void LogStore::setRotation(uint64_t bytes, int64_t seconds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (bytes > 0) maxBytes = bytes;
+    if (seconds > 0) maxSeconds = seconds;
+}
+
+void LogStore::add(const json& log, const std::string& line) {
+    int64_t time;
+    std::string plate, user;
+    recordKeys(log, time, plate, user);
+    batch += line;
+    batch += '\n';
+    std::lock_guard<std::mutex> lock(mutex);
+    active.note(time, plate, user);
+}
+
+void LogStore::commit() {
+    size_t off = 0;
+    while (fd >= 0 && off < batch.size()) {
+        ssize_t n = ::write(fd, batch.data() + off, batch.size() - off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error: Could not write " << activeFile << std::endl;
+            break;
+        }
+        off += static_cast<size_t>(n);
+    }
+    activeBytes += off;
+    batch.clear();
+
+    int64_t now = utils::nowEpoch();
+    uint64_t bytesLimit;
+    int64_t secondsLimit;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        bytesLimit = maxBytes;
+        secondsLimit = maxSeconds;
+    }
+    if (activeBytes > 0 && (activeBytes >= bytesLimit || now - activeOpened >= secondsLimit)) rotate(now);
+}
+
+// 把当前日志改名为新分段并重新打开, 压缩和写索引交给压缩线程, 期间查询直接读未压缩的文件
+void LogStore::rotate(int64_t now) {
+    size_t id = nextSegment;
+    std::string logPath = segmentPath(id, ".log");
+    SegmentIndex index;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::error_code ec;
+        std::filesystem::rename(activeFile, logPath, ec);
+        if (ec) {
+            std::cerr << "Error: Could not rotate " << activeFile << ": " << ec.message() << std::endl;
+            activeOpened = now;
+            return;
+        }
+        ::close(fd);
+        nextSegment++;
+        active.path = logPath;
+        segments.push_back(std::move(active));
+        index = segments.back();
+        active = SegmentIndex();
+        active.path = activeFile;
+        activeBytes = 0;
+        activeOpened = now;
+        openActive();
+    }
+    scheduleClose(id, index);
+}
+
+std::vector<json> LogStore::query(const std::string& plate, const std::string& user, int64_t from, int64_t to,
+                                  size_t limit, size_t cursor, bool& more) {
+    std::vector<json> result;
+    more = false;
+    if (from > to) return result;
+
+    // 在锁内打开所有相关文件, 之后的轮换改名或删除不影响已打开的句柄
+    std::vector<gzFile> files;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<const SegmentIndex*> matched;
+        for (const auto& segment : segments) {
+            if (segment.matches(plate, user, from, to)) matched.push_back(&segment);
+        }
+        if (active.matches(plate, user, from, to)) matched.push_back(&active);
+        for (const auto* segment : matched) {
+            gzFile file = gzopen(segment->path.c_str(), "rb");
+            if (file) files.push_back(file);
+        }
+    }
+
+    size_t skipped = 0;
+    int64_t time;
+    std::string recordPlate, recordUser;
+    char buf[1 << 14];
+    for (gzFile file : files) {
+        gzbuffer(file, 1 << 16);
+        std::string line;
+        while (!more && gzgets(file, buf, sizeof(buf))) {
+            line += buf;
+            if (line.back() != '\n') continue;
+            // 先做子串过滤, 只解析可能匹配的行
+            if ((plate.empty() || line.find(plate) != std::string::npos) &&
+                (user.empty() || line.find(user) != std::string::npos)) {
+                json log = json::parse(line, nullptr, false);
+                if (!log.is_discarded() && log.is_object()) {
+                    recordKeys(log, time, recordPlate, recordUser);
+                    if (time >= from && time <= to && (plate.empty() || recordPlate == plate) &&
+                        (user.empty() || recordUser == user)) {
+                        if (skipped < cursor) {
+                            skipped++;
+                        } else if (result.size() == limit) {
+                            more = true;
+                        } else {
+                            result.push_back(std::move(log));
+                        }
+                    }
+                }
+            }
+            line.clear();
+        }
+        gzclose(file);
+    }
+    return result;
+}
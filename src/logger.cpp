@@ -1,50 +1,251 @@
 #include "../include/logger.hpp"
 #include "../include/utils.hpp"
-#include <fstream>
-#include <iomanip>
+#include "../include/log_store.hpp"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
 #include <iostream>
 
-std::mutex Logger::logMutex;
+static const char* LOG_FILE = "system.log";
+// 轮换出去的压缩分段和索引所在目录
+static const char* LOG_DIR = "logs";
+// 环形缓冲区容量, 必须是 2 的幂
+static const size_t RING_SIZE = 8192;
+// 后台线程空闲时的最长等待时间
+static const auto IDLE_WAIT = std::chrono::milliseconds(50);
 
-void Logger::writeLog(const nlohmann::json& log) {
-    std::lock_guard<std::mutex> lock(logMutex);
-    std::cout << log.dump(4) << std::endl;
-    std::ofstream file("system.log", std::ios::app);
-    if (file) {
-        file << log.dump() << "\n";
+// 请求线程只把记录放进无锁环形缓冲区, 格式化和文件/控制台输出都在后台线程完成
+// 缓冲区为多生产者单消费者: 每个格子带序号, 生产者用 CAS 抢占写位置, 写完后发布序号
+class Logger::Worker {
+public:
+    Worker() : cells(new Cell[RING_SIZE]) {
+        for (size_t i = 0; i < RING_SIZE; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+        store.open(LOG_FILE, LOG_DIR);
+        thread = std::thread(&Worker::run, this);
     }
+
+    ~Worker() {
+        stop = true;
+        wake();
+        if (thread.joinable()) thread.join();
+    }
+
+    void push(Record&& record) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & (RING_SIZE - 1)];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.record = std::move(record);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    if (sleeping.load(std::memory_order_acquire)) wake();
+                    return;
+                }
+            } else if (diff < 0) {
+                // 缓冲区已满
+                if (overflow.load(std::memory_order_relaxed) == LogOverflow::Drop) {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                wake();
+                std::this_thread::yield();
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void flush() {
+        size_t target = enqueuePos.load(std::memory_order_acquire);
+        wake();
+        std::unique_lock<std::mutex> lock(mutex);
+        flushedCv.wait(lock, [&] { return written >= target || stop; });
+    }
+
+    std::atomic<LogStdout> stdoutLevel{LogStdout::Compact};
+    std::atomic<LogOverflow> overflow{LogOverflow::Block};
+    std::atomic<uint64_t> dropped{0};
+    LogStore store;
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        Record record;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<size_t> enqueuePos{0};
+    alignas(64) size_t dequeuePos = 0;
+
+    std::atomic<bool> stop{false};
+    std::atomic<bool> sleeping{false};
+    std::mutex mutex;
+    std::condition_variable wakeCv;
+    std::condition_variable flushedCv;
+    size_t written = 0;
+    uint64_t droppedReported = 0;
+    std::thread thread;
+
+    void wake() {
+        std::lock_guard<std::mutex> lock(mutex);
+        wakeCv.notify_one();
+    }
+
+    bool pop(Record& record) {
+        Cell& cell = cells[dequeuePos & (RING_SIZE - 1)];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        if (seq != dequeuePos + 1) return false;
+        record = std::move(cell.record);
+        cell.sequence.store(dequeuePos + RING_SIZE, std::memory_order_release);
+        dequeuePos++;
+        return true;
+    }
+
+    void run() {
+        std::string consoleData;
+        Record record;
+        for (;;) {
+            consoleData.clear();
+            LogStdout level = stdoutLevel.load(std::memory_order_relaxed);
+            size_t count = 0;
+            while (count < RING_SIZE && pop(record)) {
+                nlohmann::json log = toJson(record);
+                std::string line = log.dump();
+                store.add(log, line);
+                if (level == LogStdout::Compact) {
+                    consoleData += line;
+                    consoleData += '\n';
+                } else if (level == LogStdout::Pretty) {
+                    consoleData += log.dump(4);
+                    consoleData += '\n';
+                }
+                count++;
+            }
+            // 丢弃计数作为一条普通日志写入, 便于事后发现缺失的时间段
+            uint64_t droppedNow = dropped.load(std::memory_order_relaxed);
+            if (droppedNow != droppedReported) {
+                nlohmann::json log = {
+                    {"timestamp", utils::getCurrentTimeISO()},
+                    {"action", "log_dropped"},
+                    {"message", std::to_string(droppedNow - droppedReported) + " log records dropped"}
+                };
+                store.add(log, log.dump());
+                if (level != LogStdout::Off) consoleData += log.dump() + "\n";
+                droppedReported = droppedNow;
+            }
+            // 整批一次写入文件, 同时检查是否需要轮换; 控制台同样整批输出
+            store.commit();
+            if (!consoleData.empty()) std::cout << consoleData << std::flush;
+
+            std::unique_lock<std::mutex> lock(mutex);
+            written += count;
+            flushedCv.notify_all();
+            if (count == RING_SIZE) continue;
+            if (stop) {
+                // 退出前再排空一次, 之后的记录直接丢弃
+                lock.unlock();
+                if (cellReady()) continue;
+                break;
+            }
+            sleeping.store(true, std::memory_order_release);
+            if (!cellReady()) wakeCv.wait_for(lock, IDLE_WAIT);
+            sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    bool cellReady() const {
+        const Cell& cell = cells[dequeuePos & (RING_SIZE - 1)];
+        return cell.sequence.load(std::memory_order_acquire) == dequeuePos + 1;
+    }
+};
+
+Logger::Worker& Logger::worker() {
+    static Worker instance;
+    return instance;
 }
 
-// 记录用户操作
-void Logger::logUser(const std::string& username, const std::string& action, const std::string& message) {
+nlohmann::json Logger::toJson(const Record& record) {
     nlohmann::json log = {
-        {"timestamp", utils::getCurrentTimeISO()},
-        {"user", username},
-        {"action", action},
-        {"message", message}
+        {"timestamp", utils::formatTime(record.time)},
+        {"action", record.action},
+        {"message", record.message}
     };
-    writeLog(log);
+    if (record.kind != Vehicle) log["user"] = record.user;
+    if (record.kind != User) log["license_plate"] = record.plate;
+    return log;
+}
+
+void Logger::configure(const nlohmann::json& config) {
+    if (!config.contains("log") || !config["log"].is_object()) return;
+    const auto& log = config["log"];
+    std::string level = log.value("stdout", "");
+    if (level == "off") setStdout(LogStdout::Off);
+    else if (level == "compact") setStdout(LogStdout::Compact);
+    else if (level == "pretty") setStdout(LogStdout::Pretty);
+    std::string policy = log.value("overflow", "");
+    if (policy == "block") setOverflow(LogOverflow::Block);
+    else if (policy == "drop") setOverflow(LogOverflow::Drop);
+    worker().store.setRotation(log.value("rotate_bytes", uint64_t(0)), log.value("rotate_seconds", int64_t(0)));
+}
+
+void Logger::setStdout(LogStdout level) {
+    worker().stdoutLevel = level;
+}
+
+void Logger::setOverflow(LogOverflow policy) {
+    worker().overflow = policy;
+}
+
+uint64_t Logger::droppedCount() {
+    return worker().dropped.load();
+}
+
+void Logger::flush() {
+    worker().flush();
+}
+
+std::vector<nlohmann::json> Logger::queryAudit(const std::string& plate, const std::string& user, int64_t from, int64_t to,
+                                               size_t limit, size_t cursor, bool& more) {
+    // 先等缓冲区中的记录写出, 保证刚发生的操作也能查到
+    flush();
+    return worker().store.query(plate, user, from, to, limit, cursor, more);
+}
+
+// 记录用户操作
+void Logger::logUser(const std::string& username, const std::string& action, const std::string& message) {
+    Record record;
+    record.time = utils::nowEpoch();
+    record.kind = User;
+    record.user = username;
+    record.action = action;
+    record.message = message;
+    worker().push(std::move(record));
 }
 
 // 记录车辆操作
 void Logger::logVehicle(const std::string& plate, const std::string& action, const std::string& message) {
-    nlohmann::json log = {
-        {"timestamp", utils::getCurrentTimeISO()},
-        {"license_plate", plate},
-        {"action", action},
-        {"message", message}
-    };
-    writeLog(log);
+    Record record;
+    record.time = utils::nowEpoch();
+    record.kind = Vehicle;
+    record.plate = plate;
+    record.action = action;
+    record.message = message;
+    worker().push(std::move(record));
 }
 
 // 记录管理员操作
 void Logger::logAdmin(const std::string& admin, const std::string& action, const std::string& plate, const std::string& message) {
-    nlohmann::json log = {
-        {"timestamp", utils::getCurrentTimeISO()},
-        {"user", admin},
-        {"action", action},
-        {"license_plate", plate},
-        {"message", message}
-    };
-    writeLog(log);
-}
\ No newline at end of file
+    Record record;
+    record.time = utils::nowEpoch();
+    record.kind = Admin;
+    record.user = admin;
+    record.plate = plate;
+    record.action = action;
+    record.message = message;
+    worker().push(std::move(record));
+}
@@ -1,5 +1,7 @@
 #include "../include/auth.hpp"
 #include "../include/database.hpp"
+#include "../include/history.hpp"
+#include "../include/config.hpp"
 #include "../include/logger.hpp"
 #include "../include/vehicle.hpp"
 #include "httplib.h"
@@ -7,8 +9,92 @@
 #include "../include/utils.hpp"
 
 #include <iostream>
+#include <algorithm>
+#include <unordered_map>
+#include <climits>
+#include <limits>
 using json = nlohmann::json;
 
+// 请求中的时间字符串转为 epoch 秒, 未提供时使用服务器当前时间
+static bool requestTime(const json& body, int64_t& time) {
+    time = utils::nowEpoch();
+    if (!body.contains("timestamp")) return true;
+    return body["timestamp"].is_string() && utils::parseTime(body["timestamp"].get<std::string>(), time);
+}
+
+// 幂等键取自请求头 Idempotency-Key 或请求体 event_id, 按用户区分
+static std::string idempotencyKey(const httplib::Request& req, const json& body, const std::string& username) {
+    std::string key = req.get_header_value("Idempotency-Key");
+    if (key.empty() && body.contains("event_id") && body["event_id"].is_string()) key = body["event_id"];
+    return key.empty() ? key : username + ":" + key;
+}
+
+// 在车牌锁内先查幂等表, 重复请求直接返回原响应 (返回 true); 否则开始一个批次,
+// 本次请求的修改和响应在 finishIdempotent 中一起落盘. 没有幂等键的请求同样走这一流程
+static bool beginIdempotent(const std::string& key, const std::string& plate,
+                            std::unique_lock<std::recursive_mutex>& lock, httplib::Response& res) {
+    auto& db = Database::getInstance();
+    lock = db.lockPlate(plate);
+    std::string cached;
+    if (!key.empty() && db.findResponse(key, cached)) {
+        res.set_content(cached, "application/json");
+        return true;
+    }
+    db.beginBatch();
+    return false;
+}
+
+static void finishIdempotent(const std::string& key, httplib::Response& res) {
+    auto& db = Database::getInstance();
+    // 请求格式错误的响应不记录, 客户端修正后可以用同一个键重试
+    if (!key.empty() && res.status != 400) db.saveResponse(key, res.body);
+    if (!db.commitBatch()) {
+        res.set_content(json{{"result", "fail"}, {"message", "数据库错误"}}.dump(), "application/json");
+    }
+}
+
+// 单车辆接口默认附带的最近历史条数, 完整历史通过分页接口获取
+static const size_t RECENT_HISTORY = 10;
+// 历史分页接口每页最多条数
+static const size_t HISTORY_PAGE_MAX = 1000;
+// 全局事件查询每页最多条数
+static const size_t EVENTS_PAGE_MAX = 10000;
+// 批量上报接口每次最多事件数
+static const size_t BATCH_MAX = 1000;
+
+static std::string timeString(int64_t t) {
+    return t > 0 ? utils::formatTime(t) : std::string();
+}
+
+static json historyEventToJson(const HistoryEvent& e) {
+    json item = {
+        {"type", e.type == static_cast<uint8_t>(VehicleEvent::Entry) ? "entry" : "exit"},
+        {"time", timeString(e.time)}
+    };
+    if (e.type == static_cast<uint8_t>(VehicleEvent::Exit)) item["fee"] = e.fee;
+    return item;
+}
+
+// 车辆记录内部以 epoch 秒保存时间, 只在返回给客户端时生成 JSON
+static json vehicleToResponse(const std::string& plate, const VehicleRecord& v) {
+    json info = {
+        {"license_plate", plate},
+        {"is_inside", static_cast<bool>(v.inside)},
+        {"is_monthly", static_cast<bool>(v.monthly)},
+        {"is_blacklisted", static_cast<bool>(v.blacklisted)},
+        {"entry_time", timeString(v.entryTime)},
+        {"history_count", HistoryLog::getInstance().count(plate)},
+        {"history_entries", json::array()},
+        {"history_exits", json::array()}
+    };
+    if (v.monthlyExpiry > 0) info["monthly_expiry"] = timeString(v.monthlyExpiry);
+    for (const auto& e : HistoryLog::getInstance().recent(plate, RECENT_HISTORY)) {
+        bool isEntry = e.type == static_cast<uint8_t>(VehicleEvent::Entry);
+        info[isEntry ? "history_entries" : "history_exits"].push_back(timeString(e.time));
+    }
+    return info;
+}
+
 void setupRoutes(httplib::Server& svr) {
     // 状态检测
     svr.Get("/api/alive", [](const httplib::Request&, httplib::Response& res) {
@@ -52,32 +138,30 @@ void setupRoutes(httplib::Server& svr) {
 
     // OpenCV 接口
     svr.Post("/api/opencv/process", [](const httplib::Request& req, httplib::Response& res) {
+        std::unique_lock<std::recursive_mutex> lock;
         try {
             auto body = json::parse(req.body);
             std::string token = body["token"];
             std::string plate = body["license_plate"];
             std::string action = body["action"];
-            std::string time = body.value("timestamp", utils::getCurrentTimeISO());
-
-            // 从数据库验证bot token
-            auto users = Database::getInstance().getUsers();
-            bool validBot = false;
-            std::string botUsername;
-
-            for (const auto& user : users) {
-                if (user["role"] == "bot" && user["auth"] == token) {
-                    validBot = true;
-                    botUsername = user["username"];
-                    break;
-                }
+            int64_t time;
+            if (!requestTime(body, time)) {
+                res.status = 400;
+                res.set_content(json{{"error", "Invalid timestamp"}}.dump(), "application/json");
+                return;
             }
 
-            if (!validBot) {
+            // 从用户目录验证bot token
+            std::string botUsername;
+            if (!Database::getInstance().findBotByToken(token, botUsername)) {
                 res.status = 401;
                 res.set_content(json{{"error", "Invalid bot token"}}.dump(), "application/json");
                 return;
             }
 
+            std::string key = idempotencyKey(req, body, botUsername);
+            if (beginIdempotent(key, plate, lock, res)) return;
+
             // 处理车辆进出
             if (action == "entry") {
                 std::string msg;
@@ -108,14 +192,156 @@ void setupRoutes(httplib::Server& svr) {
                 res.status = 400;
                 res.set_content(json{{"error", "Invalid action"}}.dump(), "application/json");
             }
+            finishIdempotent(key, res);
         } catch (...) {
+            // 已经应用到内存的修改必须在释放车牌锁前落盘
+            Database::getInstance().commitBatch();
             res.status = 400;
             res.set_content(json{{"error", "Bad request"}}.dump(), "application/json");
         }
     });
 
+    // 批量处理 bot 上报的进出场事件: events 按数组顺序处理, 同一车牌保持先后顺序, 整批只落盘一次
+    // 每条事件单独返回结果, 格式与 /api/opencv/process 相同; 格式错误的事件返回 {"result": "error"}
+    svr.Post("/api/opencv/batch", [](const httplib::Request& req, httplib::Response& res) {
+        std::vector<std::unique_lock<std::recursive_mutex>> locks;
+        try {
+            auto body = json::parse(req.body);
+            std::string token = body["token"];
+
+            std::string botUsername;
+            if (!Database::getInstance().findBotByToken(token, botUsername)) {
+                res.status = 401;
+                res.set_content(json{{"error", "Invalid bot token"}}.dump(), "application/json");
+                return;
+            }
+
+            const json& items = body.at("events");
+            if (!items.is_array() || items.size() > BATCH_MAX) {
+                res.status = 400;
+                res.set_content(json{{"error", "Bad request"}}.dump(), "application/json");
+                return;
+            }
+
+            json results = json::array();
+            std::vector<GateEvent> events;
+            std::vector<std::string> keys;
+            std::vector<size_t> positions;
+            for (const auto& item : items) {
+                GateEvent e;
+                std::string action = item.value("action", "");
+                if (action == "entry") e.action = VehicleEvent::Entry;
+                else if (action == "exit") e.action = VehicleEvent::Exit;
+                if (!item.contains("license_plate") || !item["license_plate"].is_string() || e.action == VehicleEvent::None) {
+                    results.push_back({{"result", "error"}, {"error", "Invalid action"}});
+                    continue;
+                }
+                if (!requestTime(item, e.time)) {
+                    results.push_back({{"result", "error"}, {"error", "Invalid timestamp"}});
+                    continue;
+                }
+                e.plate = item["license_plate"];
+                keys.push_back(item.contains("event_id") && item["event_id"].is_string()
+                                   ? botUsername + ":" + item["event_id"].get<std::string>() : std::string());
+                positions.push_back(results.size());
+                results.push_back(nullptr);
+                events.push_back(std::move(e));
+            }
+
+            // 锁住全部车牌后先查幂等表, 已处理过的事件 (包括本批次中重复的键) 直接返回原结果
+            auto& db = Database::getInstance();
+            std::vector<std::string> plates;
+            for (const auto& e : events) plates.push_back(e.plate);
+            locks = db.lockPlates(plates);
+            std::vector<GateEvent> pending;
+            std::vector<size_t> pendingIndex;
+            std::unordered_map<std::string, size_t> firstByKey;
+            std::vector<std::pair<size_t, size_t>> repeats;
+            for (size_t i = 0; i < events.size(); ++i) {
+                std::string cached;
+                if (!keys[i].empty() && db.findResponse(keys[i], cached)) {
+                    results[positions[i]] = json::parse(cached);
+                } else if (!keys[i].empty() && firstByKey.count(keys[i])) {
+                    repeats.emplace_back(i, firstByKey[keys[i]]);
+                } else {
+                    if (!keys[i].empty()) firstByKey[keys[i]] = i;
+                    pendingIndex.push_back(i);
+                    pending.push_back(events[i]);
+                }
+            }
+
+            std::vector<GateResult> outcomes;
+            db.beginBatch();
+            VehicleManager::applyBatch(pending, outcomes);
+            for (size_t j = 0; j < pending.size(); ++j) {
+                size_t i = pendingIndex[j];
+                const auto& e = events[i];
+                const auto& r = outcomes[j];
+                const char* action = e.action == VehicleEvent::Entry ? "entry" : "exit";
+                json item = {{"result", r.success ? "success" : "fail"}, {"message", r.msg}};
+                if (r.success && e.action == VehicleEvent::Exit) {
+                    item["parking_duration"] = r.duration;
+                    item["fee"] = r.fee;
+                }
+                Logger::logVehicle(e.plate, action, "[Bot:" + botUsername + "] " + (r.success ? "" : "Failed: ") + r.msg);
+                if (!keys[i].empty()) db.saveResponse(keys[i], item.dump());
+                results[positions[i]] = item;
+            }
+            if (!db.commitBatch()) {
+                for (size_t i : pendingIndex) {
+                    if (results[positions[i]]["result"] == "success") {
+                        results[positions[i]] = {{"result", "fail"}, {"message", "数据库错误"}};
+                    }
+                }
+            }
+            for (const auto& [i, first] : repeats) results[positions[i]] = results[positions[first]];
+            res.set_content(json{{"results", results}}.dump(), "application/json");
+        } catch (...) {
+            // 已经应用到内存的修改必须在释放车牌锁前落盘
+            Database::getInstance().commitBatch();
+            res.status = 400;
+            res.set_content(json{{"error", "Bad request"}}.dump(), "application/json");
+        }
+    });
+
+    // 分页获取车辆历史记录, 参数 from/to 为时间字符串, cursor 为上一页返回的 next_cursor
+    svr.Get("/api/vehicles/([^/]+)/history", [](const httplib::Request& req, httplib::Response& res) {
+        std::string token = req.get_header_value("Authorization");
+        std::string role, user;
+        if (!Auth::getInstance().validateToken(token, role, user)) {
+            res.status = 401;
+            res.set_content(json{{"error", "Unauthorized"}}.dump(), "application/json");
+            return;
+        }
+
+        std::string plate = req.matches[1];
+        int64_t from = 0, to = INT64_MAX;
+        size_t limit = 100, cursor = 0;
+        try {
+            if (req.has_param("from") && !utils::parseTime(req.get_param_value("from"), from)) throw std::invalid_argument("from");
+            if (req.has_param("to") && !utils::parseTime(req.get_param_value("to"), to)) throw std::invalid_argument("to");
+            if (req.has_param("limit")) limit = std::stoul(req.get_param_value("limit"));
+            if (req.has_param("cursor")) cursor = std::stoul(req.get_param_value("cursor"));
+        } catch (...) {
+            res.status = 400;
+            res.set_content(json{{"error", "Bad request"}}.dump(), "application/json");
+            return;
+        }
+        limit = std::min(std::max<size_t>(limit, 1), HISTORY_PAGE_MAX);
+
+        auto& history = HistoryLog::getInstance();
+        size_t next;
+        json events = json::array();
+        for (const auto& e : history.query(plate, from, to, limit, cursor, next)) {
+            events.push_back(historyEventToJson(e));
+        }
+        json response = {{"license_plate", plate}, {"events", events}, {"next_cursor", nullptr}};
+        if (next < history.count(plate)) response["next_cursor"] = next;
+        res.set_content(response.dump(), "application/json");
+    });
+
     // 获取单车辆信息
-    svr.Get("/api/vehicles/(.*)", [](const httplib::Request& req, httplib::Response& res) {
+    svr.Get("/api/vehicles/([^/]+)", [](const httplib::Request& req, httplib::Response& res) {
         std::string token = req.get_header_value("Authorization");
         std::string role, user;
         if (!Auth::getInstance().validateToken(token, role, user)) {
@@ -125,14 +351,13 @@ void setupRoutes(httplib::Server& svr) {
         }
 
         std::string plate = req.matches[1];
-        auto vehicles = Database::getInstance().getVehicles();
         double fee;
         std::string duration, msg;
-        std::string time = utils::getCurrentTimeISO();
-        json vehicle_info;
-        if (vehicles.contains(plate)) {
-            vehicle_info = vehicles[plate];
-            if (vehicle_info["is_inside"] == true) {
+        int64_t time = utils::nowEpoch();
+        VehicleRecord vehicle;
+        if (Database::getInstance().getVehicle(plate, vehicle)) {
+            json vehicle_info = vehicleToResponse(plate, vehicle);
+            if (vehicle.inside) {
                 VehicleManager::getDuration(plate, time, duration, fee, msg);
                 vehicle_info["duration"] = duration;
                 vehicle_info["fee"] = fee;
@@ -163,13 +388,58 @@ void setupRoutes(httplib::Server& svr) {
             return;
         }
 
-        auto vehicles = Database::getInstance().getVehicles();
-        json plates = json::array();
-        for (auto& [plate, _] : vehicles.items()) {
-            plates.push_back(plate);
+        json plates = Database::getInstance().getPlates();
+        res.set_content(json{{"plates", plates}}.dump(), "application/json");
+    });
+
+    // 按时间范围查询所有车辆的进出场事件 (非bot用户可访问)
+    // 参数 from/to 为时间字符串, type 为 entry/exit (可选), cursor 为上一页返回的 next_cursor
+    svr.Get("/api/events", [](const httplib::Request& req, httplib::Response& res) {
+        std::string token = req.get_header_value("Authorization");
+        std::string role, username;
+        if (!Auth::getInstance().validateToken(token, role, username)) {
+            res.status = 401;
+            res.set_content(json{{"error", "Unauthorized"}}.dump(), "application/json");
+            return;
+        }
+
+        if (role == "bot") {
+            res.status = 403;
+            res.set_content(json{{"error", "Forbidden for bot users"}}.dump(), "application/json");
+            return;
+        }
+
+        int64_t from = 0, to = 0;
+        size_t limit = 1000, cursor = 0;
+        VehicleEvent type = VehicleEvent::None;
+        try {
+            if (!utils::parseTime(req.get_param_value("from"), from) ||
+                !utils::parseTime(req.get_param_value("to"), to)) {
+                throw std::invalid_argument("from/to");
+            }
+            std::string typeParam = req.get_param_value("type");
+            if (typeParam == "entry") type = VehicleEvent::Entry;
+            else if (typeParam == "exit") type = VehicleEvent::Exit;
+            else if (!typeParam.empty()) throw std::invalid_argument("type");
+            if (req.has_param("limit")) limit = std::stoul(req.get_param_value("limit"));
+            if (req.has_param("cursor")) cursor = std::stoul(req.get_param_value("cursor"));
+        } catch (...) {
+            res.status = 400;
+            res.set_content(json{{"error", "Bad request"}}.dump(), "application/json");
+            return;
         }
+        limit = std::min(std::max<size_t>(limit, 1), EVENTS_PAGE_MAX);
 
-        res.set_content(json{{"plates", plates}}.dump(), "application/json");
+        bool more;
+        json events = json::array();
+        for (const auto& [plate, e] : HistoryLog::getInstance().queryRange(from, to, type, limit, cursor, more)) {
+            json item = historyEventToJson(e);
+            item["license_plate"] = plate;
+            events.push_back(item);
+        }
+        json response = {{"events", events}, {"next_cursor", nullptr}};
+        if (more) response["next_cursor"] = cursor + events.size();
+        res.set_content(response.dump(), "application/json");
     });
 
     // 获取已入场车牌 (非bot用户可访问)
@@ -188,19 +458,88 @@ void setupRoutes(httplib::Server& svr) {
             return;
         }
 
-        auto vehicles = Database::getInstance().getVehicles();
-        json inside_plates = json::array();
-        for (auto& [plate, data] : vehicles.items()) {
-            if (data["is_inside"] == true) {
-                inside_plates.push_back(plate);
+        json inside_plates = Database::getInstance().getInsidePlates();
+        res.set_content(json{{"plates", inside_plates}}.dump(), "application/json");
+    });
+
+    // 获取在场车辆数 (非bot用户可访问)
+    svr.Get("/api/occupancy", [](const httplib::Request& req, httplib::Response& res) {
+        std::string token = req.get_header_value("Authorization");
+        std::string role, username;
+        if (!Auth::getInstance().validateToken(token, role, username)) {
+            res.status = 401;
+            res.set_content(json{{"error", "Unauthorized"}}.dump(), "application/json");
+            return;
+        }
+
+        if (role == "bot") {
+            res.status = 403;
+            res.set_content(json{{"error", "Forbidden for bot users"}}.dump(), "application/json");
+            return;
+        }
+
+        res.set_content(json{{"count", Database::getInstance().getInsideCount()}}.dump(), "application/json");
+    });
+
+    // 会话统计 (仅管理员)
+    svr.Get("/api/admin/sessions", [](const httplib::Request& req, httplib::Response& res) {
+        std::string token = req.get_header_value("Authorization");
+        std::string role, username;
+        if (!Auth::getInstance().validateToken(token, role, username) || role != "admin") {
+            res.status = 403;
+            res.set_content(json{{"error", "Forbidden: Admin access required"}}.dump(), "application/json");
+            return;
+        }
+
+        auto stats = Auth::getInstance().getSessionStats();
+        json response = {
+            {"active", stats.active},
+            {"created", stats.created},
+            {"expired", stats.expired},
+            {"logged_out", stats.removed}
+        };
+        res.set_content(response.dump(), "application/json");
+    });
+
+    // 审计日志查询 (仅管理员), 参数 plate/user/from/to 均可选, cursor 为上一页返回的 next_cursor
+    svr.Get("/api/admin/audit", [](const httplib::Request& req, httplib::Response& res) {
+        std::string token = req.get_header_value("Authorization");
+        std::string role, username;
+        if (!Auth::getInstance().validateToken(token, role, username) || role != "admin") {
+            res.status = 403;
+            res.set_content(json{{"error", "Forbidden: Admin access required"}}.dump(), "application/json");
+            return;
+        }
+
+        int64_t from = std::numeric_limits<int64_t>::min(), to = std::numeric_limits<int64_t>::max();
+        size_t limit = 1000, cursor = 0;
+        try {
+            if (req.has_param("from") && !utils::parseTime(req.get_param_value("from"), from)) {
+                throw std::invalid_argument("from");
+            }
+            if (req.has_param("to") && !utils::parseTime(req.get_param_value("to"), to)) {
+                throw std::invalid_argument("to");
             }
+            if (req.has_param("limit")) limit = std::stoul(req.get_param_value("limit"));
+            if (req.has_param("cursor")) cursor = std::stoul(req.get_param_value("cursor"));
+        } catch (...) {
+            res.status = 400;
+            res.set_content(json{{"error", "Bad request"}}.dump(), "application/json");
+            return;
         }
+        limit = std::min(std::max<size_t>(limit, 1), EVENTS_PAGE_MAX);
 
-        res.set_content(json{{"plates", inside_plates}}.dump(), "application/json");
+        bool more;
+        auto records = Logger::queryAudit(req.get_param_value("plate"), req.get_param_value("user"),
+                                          from, to, limit, cursor, more);
+        json response = {{"records", records}, {"next_cursor", nullptr}};
+        if (more) response["next_cursor"] = cursor + records.size();
+        res.set_content(response.dump(), "application/json");
     });
 
     // 管理车辆
     svr.Post("/api/admin/vehicle", [](const httplib::Request& req, httplib::Response& res) {
+        std::unique_lock<std::recursive_mutex> lock;
         try {
             std::string token = req.get_header_value("Authorization");
             std::string role, username;
@@ -213,7 +552,15 @@ void setupRoutes(httplib::Server& svr) {
             auto body = json::parse(req.body);
             std::string plate = body["license_plate"];
             std::string action = body["action"];
-            std::string time = body.value("timestamp", utils::getCurrentTimeISO());
+            int64_t time;
+            if (!requestTime(body, time)) {
+                res.status = 400;
+                res.set_content(json{{"error", "Invalid timestamp"}}.dump(), "application/json");
+                return;
+            }
+
+            std::string key = idempotencyKey(req, body, username);
+            if (beginIdempotent(key, plate, lock, res)) return;
 
             if (action == "entry") {
                 std::string msg;
@@ -273,7 +620,10 @@ void setupRoutes(httplib::Server& svr) {
                 res.status = 400;
                 res.set_content(json{{"error", "Invalid action"}}.dump(), "application/json");
             }
+            finishIdempotent(key, res);
         } catch (...) {
+            // 已经应用到内存的修改必须在释放车牌锁前落盘
+            Database::getInstance().commitBatch();
             res.status = 400;
             res.set_content(json{{"error", "Bad request"}}.dump(), "application/json");
         }
@@ -318,6 +668,40 @@ int main() {
     if (!checkVehiclesJSON() || !checkUsersJSON() || !checkConfigJSON()) {
         return 1;
     }
+    if (!Config::getInstance().loadFeeConfig()) {
+        std::cerr << "Error: Could not load fee config. Exiting.\n";
+        return 1;
+    }
+    // config.json 修改后自动重新加载计费规则, 无需重启服务器
+    Config::getInstance().onFileChange("config.json", [] {
+        if (Config::getInstance().loadFeeConfig()) {
+            std::cout << "config.json reloaded." << std::endl;
+        }
+        std::ifstream config_file("config.json");
+        try {
+            Logger::configure(json::parse(config_file));
+        } catch (...) {
+        }
+    });
+    if (!Database::getInstance().loadUsers()) {
+        std::cerr << "Error: Could not load users. Exiting.\n";
+        return 1;
+    }
+    // users.json 修改后重新建立用户目录; 已登录的令牌不受影响
+    Config::getInstance().onFileChange("users.json", [] {
+        if (Database::getInstance().loadUsers()) {
+            std::cout << "users.json reloaded." << std::endl;
+        }
+    });
+    Config::getInstance().startWatching();
+    if (!HistoryLog::getInstance().open("history")) {
+        std::cerr << "Error: Could not open history log. Exiting.\n";
+        return 1;
+    }
+    if (!Database::getInstance().loadVehicles()) {
+        std::cerr << "Error: Could not load vehicle data. Exiting.\n";
+        return 1;
+    }
     httplib::Server svr;
     setupRoutes(svr);
     std::ifstream config_file("config.json");
@@ -334,6 +718,11 @@ int main() {
     }
     std::string ip = config["ip"];
     int port = config["port"];
+    Logger::configure(config);
+    if (config.contains("session_ttl")) {
+        Auth::getInstance().setSessionTtl(config["session_ttl"].get<int64_t>());
+    }
+    Auth::getInstance().startReaper();
 
     svr.listen(ip.c_str(), port);
     return 0;
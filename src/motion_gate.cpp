@@ -0,0 +1,32 @@
+#include "../include/motion_gate.hpp"
+#include <algorithm>
+
+MotionGate::MotionGate(double threshold, int pixelThreshold, int maxSkip, int scale)
+    : threshold(threshold), pixelThreshold(pixelThreshold), maxSkip(maxSkip), scale(std::max(scale, 1))
+{
+}
+
+bool MotionGate::changed(const cv::Mat& gray)
+{
+    if (threshold <= 0) return true;
+
+    cv::resize(gray, small, cv::Size(std::max(gray.cols / scale, 1), std::max(gray.rows / scale, 1)),
+               0, 0, cv::INTER_AREA);
+    if (reference.empty() || reference.size().area() != small.size().area()) {
+        reference = small.clone();
+        skipped = 0;
+        change = 1.0;
+        return true;
+    }
+
+    cv::absdiff(small, reference, diff);
+    cv::threshold(diff, diff, pixelThreshold, 255, cv::THRESH_BINARY);
+    change = static_cast<double>(cv::countNonZero(diff)) / static_cast<double>(diff.total());
+    if (change < threshold && (maxSkip <= 0 || ++skipped < maxSkip)) {
+        return false;
+    }
+
+    std::swap(reference, small);
+    skipped = 0;
+    return true;
+}
@@ -0,0 +1,115 @@
+#include "../include/plate_recognizer.hpp"
+#include <iostream>
+#include <sstream>
+#include <memory>
+#include <chrono>
+
+#include <leptonica/allheaders.h>
+
+static double elapsedMs(std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+bool loadPlateCascade(cv::CascadeClassifier& plateCascade)
+{
+    if (!plateCascade.load("haarcascade_russian_plate_number.xml")) {
+        std::cerr << "加载车牌级联模型失败" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool initOcr(tesseract::TessBaseAPI& ocr, const OcrOptions& options)
+{
+    // 车牌不是单词, 不加载词典, 以免被纠正成相近的单词; 这两项只能在 Init 时设置
+    std::vector<std::string> names = {"load_system_dawg", "load_freq_dawg"};
+    std::vector<std::string> values = {"0", "0"};
+    if (ocr.Init(nullptr, options.language.c_str(), tesseract::OEM_LSTM_ONLY, nullptr, 0, &names, &values, false)) {
+        std::cerr << "无法初始化tesseract OCR" << std::endl;
+        return false;
+    }
+    // 车牌区域只有一行字
+    ocr.SetPageSegMode(tesseract::PSM_SINGLE_LINE);
+    if (!options.whitelist.empty() && !ocr.SetVariable("tessedit_char_whitelist", options.whitelist.c_str())) {
+        std::cerr << "无法设置OCR字符白名单" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void preparePlateGray(const cv::Mat& frame, cv::Mat& gray, PlateTimings* timings)
+{
+    auto begin = std::chrono::steady_clock::now();
+    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    auto converted = std::chrono::steady_clock::now();
+    cv::equalizeHist(gray, gray);
+    if (timings) {
+        timings->convert += elapsedMs(begin, converted);
+        timings->equalize += elapsedMs(converted, std::chrono::steady_clock::now());
+    }
+}
+
+void detectPlates(cv::CascadeClassifier& plateCascade, const cv::Mat& gray, std::vector<cv::Rect>& plates)
+{
+    plateCascade.detectMultiScale(gray, plates, 1.1, 10, 0, cv::Size(30, 30));
+}
+
+// 处理车牌图像
+bool processPlatesImages(const cv::Mat& frame, cv::CascadeClassifier& plateCascade,
+                         std::vector<cv::Rect>& plates, cv::Mat& gray, PlateTimings* timings)
+{
+    preparePlateGray(frame, gray, timings);
+    auto begin = std::chrono::steady_clock::now();
+    detectPlates(plateCascade, gray, plates);
+    if (timings) timings->detect += elapsedMs(begin, std::chrono::steady_clock::now());
+    return true;
+}
+
+std::string recognizePlate(tesseract::TessBaseAPI& ocr, const cv::Mat& plateROI, int* confidence,
+                           PlateTimings* timings)
+{
+    auto begin = std::chrono::steady_clock::now();
+    cv::Mat thresh;
+    cv::threshold(plateROI, thresh, 0, 255, cv::THRESH_BINARY + cv::THRESH_OTSU);
+    auto thresholded = std::chrono::steady_clock::now();
+
+    ocr.SetImage(thresh.data, thresh.cols, thresh.rows, 1, thresh.step);
+    // 车牌截图没有分辨率信息, 给一个固定值, 避免每次都输出警告
+    ocr.SetSourceResolution(70);
+    std::unique_ptr<char[]> text(ocr.GetUTF8Text());
+    std::string plateText = text ? std::string(text.get()) : std::string();
+    if (confidence) *confidence = ocr.MeanTextConf();
+    // 释放本次的图像和识别结果, 保留已加载的模型
+    ocr.Clear();
+    if (timings) {
+        timings->threshold += elapsedMs(begin, thresholded);
+        timings->ocr += elapsedMs(thresholded, std::chrono::steady_clock::now());
+    }
+
+    std::istringstream iss(plateText);
+    std::string word, result;
+    while(iss >> word) {
+        result += word;
+    }
+    return result;
+}
+
+// 获取车牌字符串
+bool getPlate(const std::vector<cv::Rect>& plates,
+              std::vector<std::string>& plateStrings,
+              tesseract::TessBaseAPI& ocr,
+              cv::Mat& frame,
+              const cv::Mat& gray,
+              PlateTimings* timings)
+{
+    for (size_t i = 0; i < plates.size(); i++)
+    {
+        cv::rectangle(frame, plates[i], cv::Scalar(0, 255, 0), 2);
+        std::string result = recognizePlate(ocr, gray(plates[i]), nullptr, timings);
+        if (!result.empty()) {
+            plateStrings.push_back(result);
+        }
+    }
+    return true;
+}
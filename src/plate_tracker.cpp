@@ -0,0 +1,51 @@
+#include "../include/plate_tracker.hpp"
+#include <algorithm>
+
+PlateTracker::PlateTracker(double minScore) : minScore(minScore)
+{
+}
+
+void PlateTracker::reset(const cv::Mat& gray, const std::vector<cv::Rect>& plates)
+{
+    tracks.clear();
+    cv::Rect bounds(0, 0, gray.cols, gray.rows);
+    for (const auto& rect : plates) {
+        cv::Rect clipped = rect & bounds;
+        if (clipped.empty()) continue;
+        Track track;
+        track.templ = gray(clipped).clone();
+        track.rect = clipped;
+        tracks.push_back(track);
+    }
+}
+
+bool PlateTracker::update(const cv::Mat& gray, std::vector<cv::Rect>& plates)
+{
+    plates.clear();
+    if (tracks.empty()) return false;
+
+    cv::Rect bounds(0, 0, gray.cols, gray.rows);
+    score = 1.0;
+    for (auto& track : tracks) {
+        int mx = std::max(track.rect.width / 2, MIN_MARGIN);
+        int my = std::max(track.rect.height / 2, MIN_MARGIN);
+        cv::Rect window = cv::Rect(track.rect.x - mx, track.rect.y - my,
+                                   track.rect.width + 2 * mx, track.rect.height + 2 * my) & bounds;
+        // 车牌移出画面边缘, 搜索窗口放不下模板
+        if (window.width < track.templ.cols || window.height < track.templ.rows) {
+            score = 0.0;
+            return false;
+        }
+
+        cv::matchTemplate(gray(window), track.templ, result, cv::TM_CCOEFF_NORMED);
+        double maxVal = 0.0;
+        cv::Point maxLoc;
+        cv::minMaxLoc(result, nullptr, &maxVal, nullptr, &maxLoc);
+        score = std::min(score, maxVal);
+        if (maxVal < minScore) return false;
+
+        track.rect = cv::Rect(window.x + maxLoc.x, window.y + maxLoc.y, track.templ.cols, track.templ.rows);
+        plates.push_back(track.rect);
+    }
+    return true;
+}
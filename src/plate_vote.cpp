@@ -0,0 +1,74 @@
+#include "../include/plate_vote.hpp"
+#include <map>
+#include <algorithm>
+
+// 把 UTF-8 字符串拆成单个字符, 车牌可能含有汉字
+static std::vector<std::string> splitUtf8(const std::string& text)
+{
+    std::vector<std::string> chars;
+    size_t i = 0;
+    while (i < text.size()) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        size_t len = 1;
+        if (c >= 0xF0) len = 4;
+        else if (c >= 0xE0) len = 3;
+        else if (c >= 0xC0) len = 2;
+        len = std::min(len, text.size() - i);
+        chars.push_back(text.substr(i, len));
+        i += len;
+    }
+    return chars;
+}
+
+void PlateVote::add(const std::string& text, int confidence)
+{
+    Sample sample;
+    sample.chars = splitUtf8(text);
+    if (sample.chars.empty()) return;
+    // 置信度为 0 的结果也算一票, 只是分量很小
+    sample.weight = std::max(confidence, 1);
+    samples.push_back(std::move(sample));
+}
+
+std::string PlateVote::result(double& confidence) const
+{
+    confidence = 0.0;
+    if (samples.empty()) return "";
+
+    // 先表决长度, 漏字或多字的结果不参与逐位表决
+    std::map<size_t, double> lengths;
+    double total = 0.0;
+    for (const auto& s : samples) {
+        lengths[s.chars.size()] += s.weight;
+        total += s.weight;
+    }
+    size_t length = 0;
+    double lengthWeight = 0.0;
+    for (const auto& l : lengths) {
+        if (l.second > lengthWeight) {
+            length = l.first;
+            lengthWeight = l.second;
+        }
+    }
+
+    std::string text;
+    double sum = 0.0;
+    for (size_t i = 0; i < length; ++i) {
+        std::map<std::string, double> votes;
+        for (const auto& s : samples) {
+            if (s.chars.size() == length) votes[s.chars[i]] += s.weight;
+        }
+        const std::string* best = nullptr;
+        double bestWeight = 0.0;
+        for (const auto& v : votes) {
+            if (v.second > bestWeight) {
+                best = &v.first;
+                bestWeight = v.second;
+            }
+        }
+        text += *best;
+        sum += bestWeight / lengthWeight;
+    }
+    confidence = sum / static_cast<double>(length) * (lengthWeight / total);
+    return text;
+}
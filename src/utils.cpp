@@ -19,26 +19,116 @@ std::string utils::sha256(const std::string& input) {
     return ss.str();
 }
 
-// 获取当前时间的ISO格式字符串
-std::string utils::getCurrentTimeISO() {
-    std::time_t now = std::time(nullptr);
-    std::tm* tm = std::localtime(&now);
-    char buf[20];
-    std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", tm);
-    return std::string(buf);
+// 本地时区相对 UTC 的偏移, 首次使用时取一次
+// 部署地区不使用夏令时, 因此固定偏移即可, 避免每次转换都调用 mktime/localtime 抢 libc 时区锁
+static long localOffset() {
+    static const long offset = [] {
+        std::time_t now = std::time(nullptr);
+        std::tm tm = {};
+        localtime_r(&now, &tm);
+        return tm.tm_gmtoff;
+    }();
+    return offset;
+}
+
+// 公历日期与 1970-01-01 起天数互转 (Howard Hinnant 的 days_from_civil 算法)
+static int64_t daysFromCivil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+static void civilFromDays(int64_t z, int64_t& y, unsigned& m, unsigned& d) {
+    z += 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+}
+
+static unsigned daysInMonth(int64_t y, unsigned m) {
+    static const unsigned days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = y % 4 == 0 && (y % 100 != 0 || y % 400 == 0);
+    return m == 2 && leap ? 29 : days[m - 1];
+}
+
+static bool readDigits(const char* s, int n, int& out) {
+    out = 0;
+    for (int i = 0; i < n; ++i) {
+        if (s[i] < '0' || s[i] > '9') return false;
+        out = out * 10 + (s[i] - '0');
+    }
+    return true;
+}
+
+static void writeDigits(char* s, int n, int64_t v) {
+    for (int i = n - 1; i >= 0; --i) {
+        s[i] = static_cast<char>('0' + v % 10);
+        v /= 10;
+    }
 }
 
-// 将ISO格式字符串转换为时间戳
-time_t utils::isoStringToTime(const std::string& iso) {
-    std::tm tm = {};
-    std::istringstream ss(iso);
-    ss >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%S");
-    return mktime(&tm);
+int64_t utils::nowEpoch() {
+    return static_cast<int64_t>(std::time(nullptr));
 }
 
-// 计算两个ISO格式时间字符串之间的小时差
-double utils::calculateHours(const std::string& start, const std::string& end) {
-    time_t t1 = isoStringToTime(start);
-    time_t t2 = isoStringToTime(end);
-    return difftime(t2, t1) / 3600.0;
-}
\ No newline at end of file
+bool utils::parseTime(const char* s, size_t len, int64_t& out) {
+    // 只接受恰好 19 个字符: 带 'Z' 或 '+08:00' 等后缀的时间不是本地时间, 不能按本地时间解析
+    if (len != 19) return false;
+    if (s[4] != '-' || s[7] != '-' || (s[10] != 'T' && s[10] != ' ') || s[13] != ':' || s[16] != ':') {
+        return false;
+    }
+    int y, mo, d, h, mi, sec;
+    if (!readDigits(s, 4, y) || !readDigits(s + 5, 2, mo) || !readDigits(s + 8, 2, d) ||
+        !readDigits(s + 11, 2, h) || !readDigits(s + 14, 2, mi) || !readDigits(s + 17, 2, sec)) {
+        return false;
+    }
+    if (mo < 1 || mo > 12 || h > 23 || mi > 59 || sec > 60) return false;
+    if (d < 1 || static_cast<unsigned>(d) > daysInMonth(y, static_cast<unsigned>(mo))) return false;
+    int64_t days = daysFromCivil(y, static_cast<unsigned>(mo), static_cast<unsigned>(d));
+    out = days * 86400 + h * 3600 + mi * 60 + sec - localOffset();
+    return true;
+}
+
+bool utils::parseTime(const std::string& s, int64_t& out) {
+    return parseTime(s.data(), s.size(), out);
+}
+
+void utils::formatTime(int64_t epoch, char* buf) {
+    int64_t local = epoch + localOffset();
+    int64_t days = local >= 0 ? local / 86400 : (local - 86399) / 86400;
+    int64_t secs = local - days * 86400;
+    int64_t y;
+    unsigned m, d;
+    civilFromDays(days, y, m, d);
+    writeDigits(buf, 4, y);
+    buf[4] = '-';
+    writeDigits(buf + 5, 2, m);
+    buf[7] = '-';
+    writeDigits(buf + 8, 2, d);
+    buf[10] = 'T';
+    writeDigits(buf + 11, 2, secs / 3600);
+    buf[13] = ':';
+    writeDigits(buf + 14, 2, secs % 3600 / 60);
+    buf[16] = ':';
+    writeDigits(buf + 17, 2, secs % 60);
+    buf[19] = '\0';
+}
+
+std::string utils::formatTime(int64_t epoch) {
+    char buf[20];
+    formatTime(epoch, buf);
+    return std::string(buf, 19);
+}
+
+// 获取当前时间的ISO格式字符串
+std::string utils::getCurrentTimeISO() {
+    return formatTime(nowEpoch());
+}
@@ -1,98 +1,81 @@
 #include "../include/vehicle.hpp"
 #include "../include/database.hpp"
+#include "../include/config.hpp"
 #include "../include/utils.hpp"
-#include <sstream>
-#include <iostream>
+#include <algorithm>
+#include <cstdio>
 
-bool VehicleManager::getDuration(const std::string& plate, const std::string& time, std::string& duration, double& fee, std::string& msg) {
-    auto& db = Database::getInstance();
-    auto vehicles = db.getVehicles();
-    auto& v = vehicles[plate];
-
-    std::ifstream config_file("config.json");
-    if (!config_file.is_open()) {
-        msg = "无法打开配置文件";
-        return false;
-    }
-    json config;
-    try {
-        config_file >> config;
-    } catch (const json::parse_error& e) {
+// 根据车辆记录计算停车时长和费用
+static bool calcDuration(const VehicleRecord& v, int64_t time, std::string& duration, double& fee, std::string& msg) {
+    auto config = Config::getInstance().getFeeConfig();
+    if (!config) {
         msg = "配置文件错误";
         return false;
     }
-    int freeTime = config["freetime"];
-    int stageTime = config["fee_stage_time"];
-    double stagePrice = config["fee_stage_price"];
-    double dayTop = config["fee_day_top"];
+    int freeTime = config->freeTime;
+    int stageTime = config->stageTime;
+    double stagePrice = config->stagePrice;
+    double dayTop = config->dayTop;
 
-    if (!vehicles.contains(plate) || v["is_inside"] != true) {
+    if (!v.inside) {
         return false;
     }
 
-    std::string effective_entry = v["entry_time"];
-    if (v["is_monthly"] == true) {
-        std::string monthly_expiry = v["monthly_expiry"];
-        if (time <= monthly_expiry) {
-            fee = 0.0;
-            goto TIMECALC;
+    bool monthlyFree = false;
+    int64_t effective_entry = v.entryTime;
+    if (v.monthly) {
+        if (time <= v.monthlyExpiry) {
+            monthlyFree = true;
         } else {
             // 月卡已过期：重新计算计费起始时间，入场时间和月卡到期时间中取较晚
-            effective_entry = (v["entry_time"].get<std::string>() > monthly_expiry) ? v["entry_time"].get<std::string>() : monthly_expiry;
+            effective_entry = std::max(effective_entry, v.monthlyExpiry);
         }
     }
-    TIMECALC:
-    double totalHours = utils::calculateHours(effective_entry, time);
-    int totalSec = static_cast<int>(totalHours * 3600 + 0.5);
-    int totalMin = (totalSec + 59) / 60;
 
-    int chargeableMinutes = (totalMin > freeTime) ? (totalMin - freeTime) : 0;
-    int days = chargeableMinutes / (24 * 60);
-    int remainder = chargeableMinutes % (24 * 60);
-    int stages = (remainder + stageTime - 1) / stageTime;
-    if (fee != 0.0) {fee = days * dayTop + stages * stagePrice;}
+    int64_t totalSec = std::max<int64_t>(time - effective_entry, 0);
+    int64_t totalMin = (totalSec + 59) / 60;
+
+    int64_t chargeableMinutes = (totalMin > freeTime) ? (totalMin - freeTime) : 0;
+    int64_t days = chargeableMinutes / (24 * 60);
+    int64_t remainder = chargeableMinutes % (24 * 60);
+    int64_t stages = (remainder + stageTime - 1) / stageTime;
+    fee = monthlyFree ? 0.0 : days * dayTop + stages * stagePrice;
 
-    int h = totalSec / 3600;
-    int m = (totalSec % 3600) / 60;
-    int s = totalSec % 60;
-    std::ostringstream oss;
-    oss << std::setw(2) << std::setfill('0') << h << ":"
-        << std::setw(2) << std::setfill('0') << m << ":"
-        << std::setw(2) << std::setfill('0') << s;
-    duration = oss.str();
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%02lld:%02lld:%02lld",
+                  static_cast<long long>(totalSec / 3600),
+                  static_cast<long long>(totalSec % 3600 / 60),
+                  static_cast<long long>(totalSec % 60));
+    duration = buf;
     return true;
 }
 
-bool VehicleManager::entry(const std::string& plate, const std::string& time, std::string& msg) {
-    auto& db = Database::getInstance();
-    auto vehicles = db.getVehicles();
+bool VehicleManager::getDuration(const std::string& plate, int64_t time, std::string& duration, double& fee, std::string& msg) {
+    VehicleRecord v;
+    if (!Database::getInstance().getVehicle(plate, v)) {
+        return false;
+    }
+    return calcDuration(v, time, duration, fee, msg);
+}
+
+// 入场/出场的实际处理, 调用方需持有该车牌的锁
+static bool entryLocked(Database& db, const std::string& plate, int64_t time, std::string& msg) {
+    VehicleRecord v;
 
-    if (vehicles.contains(plate)) {
-        auto& v = vehicles[plate];
-        if (v["is_inside"] == true) {
+    if (db.getVehicle(plate, v)) {
+        if (v.inside) {
             msg = "车辆已经在场";
             return false;
         }
-        if (v["is_blacklisted"] == true) {
+        if (v.blacklisted) {
             msg = "黑名单车辆";
             return false;
         }
-        v["is_inside"] = true;
-        v["entry_time"] = time;
-        v["history_entries"].push_back(time);
-    } else {
-        vehicles[plate] = {
-            {"license_plate", plate},
-            {"is_inside", true},
-            {"is_monthly", false},
-            {"is_blacklisted", false},
-            {"entry_time", time},
-            {"history_entries", {time}},
-            {"history_exits", json::array()}
-        };
     }
+    v.inside = true;
+    v.entryTime = time;
 
-    if (db.saveVehicles(vehicles)) {
+    if (db.saveVehicle(plate, v, VehicleEvent::Entry, time)) {
         msg = "入场成功";
         return true;
     }
@@ -100,103 +83,92 @@ bool VehicleManager::entry(const std::string& plate, const std::string& time, st
     return false;
 }
 
-bool VehicleManager::exit(const std::string& plate, const std::string& time, double& fee, std::string& duration, std::string& msg) {
-    auto& db = Database::getInstance();
-    auto vehicles = db.getVehicles();
-    auto& v = vehicles[plate];
-    
-    if (!vehicles.contains(plate) || v["is_inside"] != true) {
+static bool exitLocked(Database& db, const std::string& plate, int64_t time, double& fee, std::string& duration, std::string& msg) {
+    VehicleRecord v;
+
+    if (!db.getVehicle(plate, v) || !v.inside) {
         msg = "找不到车辆";
         return false;
     }
 
     //计算费用
-    if (v["is_monthly"] == true) {
-        std::string monthly_expiry = v["monthly_expiry"];
-        // 如果出场时间小于或等于月卡到期时间，则免费出场
-        if (time <= monthly_expiry) {
-            fee = 0.0;
-            v["is_inside"] = false;
-            
-            if (db.saveVehicles(vehicles)) {
-            msg = "出场成功，月卡免费";
-            goto CALCTIME;
-            }
-            msg = "数据库错误";
-            return false;
-        } else {
-            // 月卡已过期：重新计算计费起始时间为入场时间和月卡到期时间中较晚者
-            std::string effective_entry = (v["entry_time"].get<std::string>() > monthly_expiry) ? v["entry_time"].get<std::string>() : monthly_expiry;
-            v["entry_time"] = effective_entry;
-            v["is_monthly"] = false;
-        }
+    if (!calcDuration(v, time, duration, fee, msg)) {
+        return false;
     }
 
-    CALCTIME:
-    getDuration(plate, time, duration, fee, msg);
-
-    if (v["is_inside"] == false) {
-        v["entry_time"] = "";
-        v["history_exits"].push_back(time);
-        return true;
+    bool monthlyFree = false;
+    if (v.monthly) {
+        // 如果出场时间小于或等于月卡到期时间，则免费出场, 否则月卡已过期
+        if (time <= v.monthlyExpiry) {
+            monthlyFree = true;
+        } else {
+            v.monthly = false;
+        }
     }
 
-    v["is_inside"] = false;
-    v["entry_time"] = "";
-    v["history_exits"].push_back(time);
-    if (db.saveVehicles(vehicles)) {
-        msg = "出场成功";
+    v.inside = false;
+    v.entryTime = 0;
+    if (db.saveVehicle(plate, v, VehicleEvent::Exit, time, fee)) {
+        msg = monthlyFree ? "出场成功，月卡免费" : "出场成功";
         return true;
     }
     msg = "数据库错误";
     return false;
 }
 
-bool VehicleManager::addMonthly(const std::string& plate, int days, std::string& msg) {
+bool VehicleManager::entry(const std::string& plate, int64_t time, std::string& msg) {
     auto& db = Database::getInstance();
-    auto vehicles = db.getVehicles();
-
-    if (!vehicles.contains(plate)) {
-        vehicles[plate] = {
-            {"license_plate", plate},
-            {"is_inside", false},
-            {"is_monthly", false},
-            {"is_blacklisted", false},
-            {"entry_time", ""},
-            {"history_entries", json::array()},
-            {"history_exits", json::array()}
-        };
-    }
-    auto& v = vehicles[plate];
-
-    // 获取当前时间
-    std::time_t now = std::time(nullptr);
-    std::time_t baseTime = now;
+    auto lock = db.lockPlate(plate);
+    return entryLocked(db, plate, time, msg);
+}
 
-    std::cout << days << std::endl;
+bool VehicleManager::exit(const std::string& plate, int64_t time, double& fee, std::string& duration, std::string& msg) {
+    auto& db = Database::getInstance();
+    auto lock = db.lockPlate(plate);
+    return exitLocked(db, plate, time, fee, duration, msg);
+}
 
-    // 如果已有未过期的月卡，则以原到期时间作为基准
-    if (v.contains("monthly_expiry") && v["monthly_expiry"].is_string()) {
-        std::istringstream iss(v["monthly_expiry"].get<std::string>());
-        std::tm tm = {};
-        if (iss >> std::get_time(&tm, "%Y-%m-%d %H:%M:%S")) {
-            std::time_t expiryTime = std::mktime(&tm);
-            if (expiryTime > now) {
-                baseTime = expiryTime;
-            }
+// 锁住批次涉及的全部车牌后按数组顺序逐条处理, 同一车牌的事件保持先后顺序; 最后统一提交一次
+bool VehicleManager::applyBatch(const std::vector<GateEvent>& events, std::vector<GateResult>& results) {
+    auto& db = Database::getInstance();
+    std::vector<std::string> plates;
+    for (const auto& e : events) plates.push_back(e.plate);
+    auto locks = db.lockPlates(plates);
+
+    results.assign(events.size(), GateResult());
+    db.beginBatch();
+    for (size_t i = 0; i < events.size(); ++i) {
+        const auto& e = events[i];
+        auto& r = results[i];
+        if (e.action == VehicleEvent::Entry) {
+            r.success = entryLocked(db, e.plate, e.time, r.msg);
+        } else if (e.action == VehicleEvent::Exit) {
+            r.success = exitLocked(db, e.plate, e.time, r.fee, r.duration, r.msg);
+        }
+    }
+    if (db.commitBatch()) return true;
+    for (auto& r : results) {
+        if (r.success) {
+            r.success = false;
+            r.msg = "数据库错误";
         }
     }
+    return false;
+}
+
+bool VehicleManager::addMonthly(const std::string& plate, int days, std::string& msg) {
+    auto& db = Database::getInstance();
+    auto lock = db.lockPlate(plate);
+    VehicleRecord v;
+    db.getVehicle(plate, v);
 
-    // 计算新的到期时间
-    std::time_t newExpiry = baseTime + days * 24 * 3600;
-    char buffer[20];
-    std::tm* newTm = std::localtime(&newExpiry);
-    std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", newTm);
+    // 如果已有未过期的月卡，则以原到期时间作为基准
+    int64_t baseTime = std::max(utils::nowEpoch(), v.monthlyExpiry);
 
-    v["is_monthly"] = true;
-    v["monthly_expiry"] = std::string(buffer);
+    v.monthly = true;
+    v.monthlyExpiry = baseTime + static_cast<int64_t>(days) * 24 * 3600;
 
-    if (db.saveVehicles(vehicles)) {
+    if (db.saveVehicle(plate, v)) {
         msg = "成功添加月卡天数";
         return true;
     }
@@ -206,29 +178,18 @@ bool VehicleManager::addMonthly(const std::string& plate, int days, std::string&
 
 bool VehicleManager::addBlacklist(const std::string& plate, std::string& msg) {
     auto& db = Database::getInstance();
-    auto vehicles = db.getVehicles();
+    auto lock = db.lockPlate(plate);
+    VehicleRecord v;
+    db.getVehicle(plate, v);
 
-    if (!vehicles.contains(plate)) {
-        vehicles[plate] = {
-            {"license_plate", plate},
-            {"is_inside", false},
-            {"is_monthly", false},
-            {"is_blacklisted", false},
-            {"entry_time", ""},
-            {"history_entries", json::array()},
-            {"history_exits", json::array()}
-        };
-    }
-    auto& v = vehicles[plate];
-
-    if (v["is_blacklisted"] == true) {
+    if (v.blacklisted) {
         msg = "这辆车已经在黑名单了";
         return false;
     }
 
-    v["is_blacklisted"] = true;
+    v.blacklisted = true;
 
-    if (db.saveVehicles(vehicles)) {
+    if (db.saveVehicle(plate, v)) {
         msg = "成功将这辆车添加到黑名单";
         return true;
     }
@@ -238,22 +199,21 @@ bool VehicleManager::addBlacklist(const std::string& plate, std::string& msg) {
 
 bool VehicleManager::removeBlacklist(const std::string& plate, std::string& msg) {
     auto& db = Database::getInstance();
-    auto vehicles = db.getVehicles();
-
-    if (!vehicles.contains(plate)) {
+    auto lock = db.lockPlate(plate);
+    VehicleRecord v;
+    if (!db.getVehicle(plate, v)) {
         msg = "这辆车不在黑名单中";
         return false;
     }
-    auto& v = vehicles[plate];
 
-    if (v["is_blacklisted"] == false) {
+    if (!v.blacklisted) {
         msg = "这辆车不在黑名单中";
         return false;
     }
 
-    v["is_blacklisted"] = false;
+    v.blacklisted = false;
 
-    if (db.saveVehicles(vehicles)) {
+    if (db.saveVehicle(plate, v)) {
         msg = "成功将这辆车从黑名单中移除";
         return true;
     }
@@ -0,0 +1,211 @@
+#include "../include/database.hpp"
+#include "../include/vehicle.hpp"
+#include "../include/config.hpp"
+#include "../include/history.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// 并发压力测试: 多个线程同时对不同车牌做入场/出场 (单条和批量混合), 以及多个线程争抢同一批车牌,
+// 检查每次成功的操作都留下了历史事件, 最终状态与成功次数一致, 没有丢失的更新
+// 同时有两个线程反复写快照, 与后台快照线程并发; 最后关闭数据库, 在子进程中从快照和日志重新加载并逐个比对
+// 数据文件写在临时目录中, 不影响当前目录
+
+static const int THREADS = 8;
+static const int PLATES_PER_THREAD = 250;
+static const int ROUNDS = 4;
+static const int SHARED_PLATES = 32;
+static const int SHARED_ATTEMPTS = 2000;
+static const int SNAPSHOT_THREADS = 2;
+static const int SNAPSHOTS_PER_THREAD = 20;
+static const int TAIL_PLATES = 20;
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cerr << "FAIL: " << what << std::endl;
+        failures++;
+    }
+}
+
+static std::string plateName(const char* prefix, int a, int b) {
+    return std::string(prefix) + std::to_string(a) + "-" + std::to_string(b);
+}
+
+static bool openStorage(const std::string& dir) {
+    if (!Config::getInstance().loadFeeConfig() || !HistoryLog::getInstance().open("history") ||
+        !Database::getInstance().loadVehicles()) {
+        std::cerr << "Error: Could not initialize storage in " << dir << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// 每个车牌的状态和历史条数
+static json dumpState() {
+    auto& db = Database::getInstance();
+    json state = json::object();
+    for (const auto& plate : db.getPlates()) {
+        VehicleRecord record;
+        db.getVehicle(plate, record);
+        state[plate] = {static_cast<bool>(record.inside), record.entryTime, HistoryLog::getInstance().count(plate)};
+    }
+    return state;
+}
+
+// 子进程: 重新加载数据目录, 与父进程关闭前记下的状态比对
+static int reload(const std::string& dir) {
+    if (::chdir(dir.c_str()) != 0 || !openStorage(dir)) return 1;
+    json expected = json::parse(std::ifstream("expected.json"));
+    json actual = dumpState();
+    for (auto& [plate, state] : expected.items()) {
+        check(actual.contains(plate) && actual[plate] == state,
+              plate + " after reload is " + (actual.contains(plate) ? actual[plate].dump() : "missing") +
+                  ", expected " + state.dump());
+    }
+    check(actual.size() == expected.size(), "reload has " + std::to_string(actual.size()) + " plates, expected " +
+                                                std::to_string(expected.size()));
+    check(Database::getInstance().verifyInsideIndex(), "inside index was inconsistent after reload");
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 3 && std::string(argv[1]) == "--reload") return reload(argv[2]);
+
+    char dir[] = "/tmp/parking_stress_XXXXXX";
+    if (!::mkdtemp(dir) || ::chdir(dir) != 0) {
+        std::cerr << "Error: Could not create temporary directory." << std::endl;
+        return 1;
+    }
+    std::ofstream("config.json") << R"({"freetime": 0, "fee_stage_time": 30, "fee_stage_price": 50, "fee_day_top": 400})";
+    if (!openStorage(dir)) return 1;
+
+    // 各线程使用自己的车牌, 奇数轮用批量接口; 每次操作都应成功
+    std::atomic<int> distinctFailures{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([t, &distinctFailures] {
+            int64_t time = 1700000000;
+            for (int round = 0; round < ROUNDS; round++) {
+                for (int i = 0; i < PLATES_PER_THREAD; i++) {
+                    std::string plate = plateName("D", t, i);
+                    if (round % 2 == 0) {
+                        std::string msg, duration;
+                        double fee = 0.0;
+                        if (!VehicleManager::entry(plate, time, msg)) distinctFailures++;
+                        if (!VehicleManager::exit(plate, time + 600, fee, duration, msg)) distinctFailures++;
+                    } else {
+                        std::vector<GateEvent> events = {{plate, VehicleEvent::Entry, time},
+                                                         {plate, VehicleEvent::Exit, time + 600}};
+                        std::vector<GateResult> results;
+                        if (!VehicleManager::applyBatch(events, results)) distinctFailures++;
+                        for (const auto& r : results) {
+                            if (!r.success) distinctFailures++;
+                        }
+                    }
+                }
+                time += 3600;
+            }
+        });
+    }
+
+    // 多个线程争抢同一批车牌: 入场和出场各自可能因状态不符而失败, 但成功的次数必须与历史记录一致
+    std::vector<std::vector<int>> entries(THREADS, std::vector<int>(SHARED_PLATES));
+    std::vector<std::vector<int>> exits(THREADS, std::vector<int>(SHARED_PLATES));
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([t, &entries, &exits] {
+            for (int n = 0; n < SHARED_ATTEMPTS; n++) {
+                int i = (n * 7 + t) % SHARED_PLATES;
+                std::string plate = plateName("S", 0, i);
+                std::string msg, duration;
+                double fee = 0.0;
+                if ((n + t) % 2 == 0) {
+                    if (VehicleManager::entry(plate, 1700000000 + n, msg)) entries[t][i]++;
+                } else {
+                    if (VehicleManager::exit(plate, 1700000000 + n, fee, duration, msg)) exits[t][i]++;
+                }
+            }
+        });
+    }
+    // 与上面的写入以及后台快照线程同时写快照, 每次都应成功
+    std::atomic<int> snapshotFailures{0};
+    for (int t = 0; t < SNAPSHOT_THREADS; t++) {
+        threads.emplace_back([&snapshotFailures] {
+            for (int n = 0; n < SNAPSHOTS_PER_THREAD; n++) {
+                if (!Database::getInstance().snapshotVehicles()) snapshotFailures++;
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    auto& db = Database::getInstance();
+    auto& history = HistoryLog::getInstance();
+    check(distinctFailures == 0, std::to_string(distinctFailures.load()) + " operations on distinct plates failed");
+    check(snapshotFailures == 0, std::to_string(snapshotFailures.load()) + " concurrent snapshots failed");
+    for (int t = 0; t < THREADS; t++) {
+        for (int i = 0; i < PLATES_PER_THREAD; i++) {
+            std::string plate = plateName("D", t, i);
+            VehicleRecord record;
+            check(db.getVehicle(plate, record) && !record.inside, plate + " should be outside");
+            check(history.count(plate) == 2 * ROUNDS, plate + " has " + std::to_string(history.count(plate)) +
+                                                          " history events, expected " + std::to_string(2 * ROUNDS));
+        }
+    }
+
+    size_t insideShared = 0;
+    for (int i = 0; i < SHARED_PLATES; i++) {
+        std::string plate = plateName("S", 0, i);
+        int in = 0, out = 0;
+        for (int t = 0; t < THREADS; t++) {
+            in += entries[t][i];
+            out += exits[t][i];
+        }
+        VehicleRecord record;
+        bool found = db.getVehicle(plate, record);
+        check(in == out || in == out + 1, plate + " has " + std::to_string(in) + " entries and " +
+                                              std::to_string(out) + " exits");
+        check(!found || static_cast<int>(record.inside) == in - out, plate + " inside flag does not match its events");
+        check(history.count(plate) == static_cast<size_t>(in + out), plate + " history does not match its events");
+        if (found && record.inside) insideShared++;
+    }
+    check(db.verifyInsideIndex(), "inside index was inconsistent");
+    check(db.getInsideCount() == insideShared, "inside count does not match");
+    check(db.snapshotVehicles(), "snapshot failed");
+
+    // 快照之后再写几条, 让重新加载时也要重放日志
+    for (int i = 0; i < TAIL_PLATES; i++) {
+        std::string msg;
+        check(VehicleManager::entry(plateName("T", 0, i), 1700100000, msg), "entry after snapshot failed");
+    }
+    std::ofstream("expected.json") << dumpState().dump();
+    db.close();
+
+    pid_t pid = ::fork();
+    if (pid == 0) {
+        ::execl("/proc/self/exe", argv[0], "--reload", dir, static_cast<char*>(nullptr));
+        ::_exit(127);
+    }
+    int status = 0;
+    check(pid > 0 && ::waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0,
+          "reloaded state does not match");
+
+    if (failures) {
+        std::cerr << failures << " check(s) failed, data kept in " << dir << std::endl;
+        return 1;
+    }
+    std::cout << "OK: " << THREADS * PLATES_PER_THREAD * ROUNDS * 2 << " events on distinct plates, "
+              << THREADS * SHARED_ATTEMPTS << " attempts on shared plates, "
+              << SNAPSHOT_THREADS * SNAPSHOTS_PER_THREAD << " concurrent snapshots, reload matched" << std::endl;
+    std::error_code ec;
+    ::chdir("/");
+    std::filesystem::remove_all(dir, ec);
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "../include/utils.hpp"
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// utils::parseTime/formatTime 的正确性检查和微基准:
+// 与原先 istringstream + get_time + mktime / localtime + strftime 的实现逐个比对结果, 并比较两者的耗时
+// 结果以 JSON 打印到标准输出; 任何不一致时返回非零, 作为 CTest 运行
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cerr << "FAIL: " << what << std::endl;
+        failures++;
+    }
+}
+
+// 原先的解析路径
+static std::time_t legacyParse(const std::string& iso) {
+    std::tm tm = {};
+    std::istringstream ss(iso);
+    ss >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%S");
+    return mktime(&tm);
+}
+
+// 原先的格式化路径
+static std::string legacyFormat(std::time_t t) {
+    std::tm tm = {};
+    localtime_r(&t, &tm);
+    char buf[20];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+    return std::string(buf);
+}
+
+// 每次调用的平均耗时 (纳秒)
+template <typename F>
+static double nsPerCall(size_t calls, F&& f) {
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < calls; ++i) f(i);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() / calls;
+}
+
+int main() {
+    // 1970 到 2100 年间每隔约 7 小时取一个时刻, 覆盖所有月份和闰年的 2 月 29 日
+    std::vector<int64_t> times;
+    std::vector<std::string> strings;
+    for (int64_t t = 86400; t < 4102444800; t += 25247) {
+        times.push_back(t);
+        strings.push_back(legacyFormat(static_cast<std::time_t>(t)));
+    }
+
+    for (size_t i = 0; i < times.size(); ++i) {
+        int64_t parsed = 0;
+        check(utils::formatTime(times[i]) == strings[i], "formatTime(" + std::to_string(times[i]) + ")");
+        check(utils::parseTime(strings[i], parsed) && parsed == times[i], "parseTime(\"" + strings[i] + "\")");
+    }
+
+    int64_t parsed = 0;
+    check(utils::parseTime("2024-02-29 12:00:00", parsed), "space separator is accepted");
+    for (const char* bad : {"2024-02-30T00:00:00", "2023-02-29T00:00:00", "2100-02-29T00:00:00", "2024-04-31T00:00:00",
+                            "2024-13-01T00:00:00", "2024-01-01T24:00:00", "2024-01-01T00:00:00Z",
+                            "2024-01-01T00:00:00+08:00", "2024-01-01T00:00", "2024/01/01T00:00:00"}) {
+        check(!utils::parseTime(bad, parsed), std::string("\"") + bad + "\" should be rejected");
+    }
+
+    // 防止循环被优化掉
+    volatile int64_t sink = 0;
+    size_t n = strings.size();
+    json report;
+    report["samples"] = n;
+    report["parse_ns"] = nsPerCall(n, [&](size_t i) {
+        int64_t t = 0;
+        utils::parseTime(strings[i], t);
+        sink = sink + t;
+    });
+    report["legacy_parse_ns"] = nsPerCall(n, [&](size_t i) { sink = sink + legacyParse(strings[i]); });
+    report["format_ns"] = nsPerCall(n, [&](size_t i) {
+        char buf[20];
+        utils::formatTime(times[i], buf);
+        sink = sink + buf[18];
+    });
+    report["legacy_format_ns"] = nsPerCall(n, [&](size_t i) { sink = sink + legacyFormat(times[i])[18]; });
+    report["failures"] = failures;
+    std::cout << report.dump(2) << std::endl;
+    return failures ? 1 : 0;
+}